@@ -0,0 +1,42 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// size rounded up so the allocation after it stays aligned
+size_t arenaSize(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void initArena(Arena *arena, size_t size) {
+  size = arenaSize(size);
+  arena->base = aligned_alloc(ARENA_ALIGN, size ? size : ARENA_ALIGN);
+  if (arena->base == NULL) {
+    perror("Failed allocating arena");
+    exit(1);
+  }
+  arena->size = size;
+  arena->used = 0;
+}
+
+// zeroed memory for size bytes
+void *arenaAlloc(Arena *arena, size_t size) {
+  size = arenaSize(size);
+  if (size > arena->size - arena->used) {
+    fprintf(stderr, "Arena out of memory: %zu of %zu bytes used, %zu more\n",
+            arena->used, arena->size, size);
+    exit(1);
+  }
+  void *p = arena->base + arena->used;
+  arena->used += size;
+  memset(p, 0, size);
+  return p;
+}
+
+// forget every allocation but keep the memory
+void resetArena(Arena *arena) { arena->used = 0; }
+
+void freeArena(Arena *arena) {
+  free(arena->base);
+  *arena = (Arena){0};
+}
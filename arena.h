@@ -0,0 +1,26 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * a bump allocator over one block of memory
+ * allocations are never freed one at a time, the whole arena is released
+ * (or reset for reuse) at once
+ */
+typedef struct Arena {
+  unsigned char *base;
+  size_t size;
+  size_t used;
+} Arena;
+
+// alignment of every allocation, enough for any type and for SIMD loads
+#define ARENA_ALIGN 32
+
+size_t arenaSize(size_t size);
+void initArena(Arena *arena, size_t size);
+void *arenaAlloc(Arena *arena, size_t size);
+void resetArena(Arena *arena);
+void freeArena(Arena *arena);
+
+#endif
@@ -0,0 +1,526 @@
+/*
+ * Benchmarks the simulation hot paths over scripted scenarios, so changes
+ * to the simulation can be compared against a baseline.
+ *
+ * Every case restores the same starting state before each timed frame and
+ * reports the mean time per frame, frames per second and percentiles.
+ *
+ * usage: ./bench [filter]
+ *   filter only runs the cases whose name contains it, e.g. "moveEnemies"
+ *
+ * Then times generating dungeons of up to 1600x1600 cells, over 10^6 rooms,
+ * in rooms per second.
+ */
+#include "collision.h"
+#include "dungeon.h"
+#include "flowfield.h"
+#include "game.h"
+#include "profiler.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if MAX_ENEMIES < 5000
+#error "build with make bench, the scenarios need room for 5000 entities"
+#endif
+
+#define MIN_FRAMES 10
+#define MAX_FRAMES 2000
+#define TIME_BUDGET 0.25 // seconds per case
+
+typedef struct Layout {
+  const char *name;
+  char tiles[TILES_X * TILES_Y + 1];
+} Layout;
+
+typedef struct Scenario {
+  Room room;
+  int count;
+  Character player;
+  EnemiesContainer enemies;
+  ProjectilesContainer pc;
+  // the enemies as characters, for the updatePos case
+  Character movers[MAX_ENEMIES];
+  Vector2 targets[MAX_ENEMIES]; // where each mover tries to move to
+} Scenario;
+
+typedef void (*FrameFn)(Scenario *s);
+
+// working copy, reset from the scenario before each frame
+Scenario work;
+ProjectilesContainer workProjectiles;
+volatile int sink;
+
+unsigned long long rngState = 1;
+
+// uniform float in [lo, hi)
+float randomRange(float lo, float hi) {
+  rngState = rngState * 6364136223846793005ULL + 1442695040888963407ULL;
+  return lo + (hi - lo) * ((rngState >> 40) / (float)(1 << 24));
+}
+
+Vector2 randomPosition(void) {
+  float x = randomRange(WALL_THICKNESS, SCREEN_WIDTH - WALL_THICKNESS);
+  float y = randomRange(WALL_THICKNESS, SCREEN_HEIGHT - WALL_THICKNESS);
+  return (Vector2){x, y};
+}
+
+// set up "count" live projectiles and enemies at random positions
+void makeScenario(Scenario *s, Room room, int count) {
+  rngState = 1;
+  s->room = room;
+  s->count = count;
+  s->player =
+      (Character){{(float)SCREEN_WIDTH / 2, (float)SCREEN_HEIGHT / 2},
+                  2.0f,
+                  STARTING_PLAYER_RADIUS,
+                  8,
+                  8,
+                  5.0f,
+                  true};
+  s->enemies.count = 0;
+  for (int i = 0; i < count; i++) {
+    Vector2 pos = randomPosition();
+    float speed = 1.0f;
+    spawnEnemy(&s->enemies, pos, speed, STARTING_PLAYER_RADIUS);
+    s->movers[i] = (Character){
+        pos, speed, STARTING_PLAYER_RADIUS, 8, 8, 5.0f, true};
+    float dx = randomRange(-1, 1) * speed;
+    float dy = randomRange(-1, 1) * speed;
+    s->targets[i] = (Vector2){pos.x + dx, pos.y + dy};
+  }
+  resetProjectiles(&s->pc);
+  for (int i = 0; i < count; i++) {
+    float speed = s->player.shotSpeed;
+    Vector2 dir[4] = {{speed, 0}, {-speed, 0}, {0, speed}, {0, -speed}};
+    shoot(dir[i % 4].x, dir[i % 4].y, randomPosition(), &s->pc);
+  }
+}
+
+void frameUpdatePos(Scenario *s) {
+  for (int i = 0; i < s->count; i++) {
+    updatePos(&s->movers[i], s->room.blocks, s->targets[i]);
+  }
+}
+
+void frameUpdateProjectiles(Scenario *s) {
+  updateProjectiles(&s->pc, s->room.blocks, &s->enemies);
+}
+
+void frameBlockCollision(Scenario *s) {
+  int hits = 0;
+  ProjectilesContainer *pc = &s->pc;
+  for (int i = 0; i < pc->count; i++) {
+    Vector2 position = {pc->x[i], pc->y[i]};
+    for (int j = 0; j < MAX_BLOCKS; j++) {
+      Vector2 c = blockCollision(s->room.blocks[j], position, pc->radius[i]);
+      hits += c.x && c.y;
+    }
+  }
+  sink = hits;
+}
+
+void frameCircleCollision(Scenario *s) {
+  int hits = 0;
+  ProjectilesContainer *pc = &s->pc;
+  EnemiesContainer *ec = &s->enemies;
+  for (int i = 0; i < pc->count; i++) {
+    Vector2 position = {pc->x[i], pc->y[i]};
+    for (int j = 0; j < ec->count; j++) {
+      hits += circleCollision(position, (Vector2){ec->x[j], ec->y[j]},
+                              pc->radius[i], ec->radius[j]);
+    }
+  }
+  sink = hits;
+}
+
+/*
+ * the integer test circleCollision used to be, kept as a baseline: it
+ * truncated the distance to whole pixels and missed circles lying inside
+ * each other
+ */
+bool circleCollisionTruncated(Vector2 pos1, Vector2 pos2, int rad1,
+                              int rad2) {
+  int radsMinus = (rad1 - rad2);
+  int radsPlus = (rad1 + rad2);
+  int xs = (pos1.x - pos2.x);
+  int ys = (pos1.y - pos2.y);
+  int term1 = radsMinus * radsMinus;
+  int term2 = xs * xs + ys * ys;
+  int term3 = radsPlus * radsPlus;
+
+  return (term1 <= term2) && (term2 <= term3);
+}
+
+void frameCircleCollisionTruncated(Scenario *s) {
+  int hits = 0;
+  ProjectilesContainer *pc = &s->pc;
+  EnemiesContainer *ec = &s->enemies;
+  for (int i = 0; i < pc->count; i++) {
+    Vector2 position = {pc->x[i], pc->y[i]};
+    for (int j = 0; j < ec->count; j++) {
+      hits +=
+          circleCollisionTruncated(position, (Vector2){ec->x[j], ec->y[j]},
+                                   pc->radius[i], ec->radius[j]);
+    }
+  }
+  sink = hits;
+}
+
+void frameBlockCollisionBatch(Scenario *s) {
+  ProjectilesContainer *pc = &s->pc;
+  memset(pc->hit, 0, pc->count);
+  blockCollisionBatch(pc->x, pc->y, pc->radius, pc->count, s->room.blocks,
+                      MAX_BLOCKS, pc->hit);
+}
+
+void frameCircleCollisionBatch(Scenario *s) {
+  ProjectilesContainer *pc = &s->pc;
+  memset(pc->hit, 0, pc->count);
+  EnemiesContainer *ec = &s->enemies;
+  circleCollisionBatch(pc->x, pc->y, pc->radius, pc->count, ec->x, ec->y,
+                       ec->radius, ec->count, pc->hit);
+}
+
+void frameEnemyBroadphase(Scenario *s) {
+  static EnemyGrid grid;
+  ProjectilesContainer *pc = &s->pc;
+  memset(pc->hit, 0, pc->count);
+  EnemiesContainer *ec = &s->enemies;
+  buildEnemyGrid(&grid, ec->x, ec->y, ec->radius, ec->count);
+  circleCollisionGrid(pc->x, pc->y, pc->radius, pc->count, &grid, pc->hit);
+}
+
+// includes building the flow field, as when the player changed tile
+void frameMoveEnemies(Scenario *s) {
+  FlowField flow = {-1, -1, {0}, {0}};
+  updateFlowField(&flow, s->room.blocks, 0, s->player.position);
+  moveEnemies(&s->enemies, s->player, s->room.blocks, &flow);
+}
+
+int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+double percentile(double *sorted, int n, double p) {
+  int idx = (int)(p * (n - 1) + 0.5);
+  return sorted[idx];
+}
+
+void runCase(const char *fnName, FrameFn fn, const Layout *layout, Room room,
+             int count, const char *filter) {
+  char name[128];
+  snprintf(name, sizeof name, "%s/%s/%d", fnName, layout->name, count);
+  if (filter && !strstr(name, filter)) {
+    return;
+  }
+
+  static Scenario scenario;
+  static double samples[MAX_FRAMES];
+  if (scenario.pc.capacity == 0) {
+    initProjectiles(&scenario.pc, PROJECTILE_CAPACITY);
+  }
+  makeScenario(&scenario, room, count);
+
+  int frames = 0;
+  double total = 0;
+  while (frames < MAX_FRAMES &&
+         (frames < MIN_FRAMES || total < TIME_BUDGET)) {
+    work = scenario;
+    copyProjectiles(&workProjectiles, &scenario.pc);
+    work.pc = workProjectiles;
+    double start = monotonicTime();
+    fn(&work);
+    double elapsed = monotonicTime() - start;
+    samples[frames++] = elapsed * 1e9;
+    total += elapsed;
+  }
+  qsort(samples, frames, sizeof *samples, compareDoubles);
+
+  double mean = total * 1e9 / frames;
+  printf("%-40s %12.0f %12.0f %12.0f %12.0f %12.0f\n", name, mean,
+         1e9 / mean, percentile(samples, frames, 0.5),
+         percentile(samples, frames, 0.9), percentile(samples, frames, 0.99));
+}
+
+/*
+ * check that every simd level and the broadphase give the same results as
+ * the scalar kernels, over random circles with many of them lined up on
+ * block edges
+ * returns the number of mismatches
+ */
+int checkKernels(Layout *layouts, int nLayouts) {
+  enum { N = 4099, OTHERS = 257 }; // not multiples of the vector widths
+  static float x[N], y[N], otherX[OTHERS], otherY[OTHERS];
+  static int rad[N], otherRad[OTHERS];
+  static unsigned char expected[N], got[N];
+  static EnemyGrid grid;
+  static Block blocks[MAX_BLOCKS];
+  SimdLevel best = getSimdLevel();
+  int mismatches = 0;
+
+  rngState = 7;
+  for (int i = 0; i < N; i++) {
+    Vector2 pos = randomPosition();
+    bool onEdge = randomRange(0, 1) < 0.5;
+    x[i] = onEdge ? (int)pos.x : pos.x;
+    y[i] = onEdge ? (int)pos.y : pos.y;
+    rad[i] = randomRange(1, 40);
+  }
+  for (int i = 0; i < OTHERS; i++) {
+    Vector2 pos = randomPosition();
+    otherX[i] = pos.x;
+    otherY[i] = pos.y;
+    otherRad[i] = randomRange(1, 40);
+  }
+
+  for (int l = 0; l < nLayouts; l++) {
+    Room room = makeRoomFromLayout(blocks, 1, 1, 1, 1, layouts[l].tiles, RED);
+    for (SimdLevel level = SIMD_SCALAR; level <= best; level++) {
+      unsigned char *out = level == SIMD_SCALAR ? expected : got;
+      setSimdLevel(level);
+      memset(out, 0, N);
+      blockCollisionBatch(x, y, rad, N, room.blocks, MAX_BLOCKS, out);
+      if (out == got && memcmp(expected, got, N) != 0) {
+        printf("block kernel %s differs from scalar in room %s\n",
+               simdLevelName(level), layouts[l].name);
+        mismatches++;
+      }
+    }
+  }
+
+  for (SimdLevel level = SIMD_SCALAR; level <= best; level++) {
+    unsigned char *out = level == SIMD_SCALAR ? expected : got;
+    setSimdLevel(level);
+    memset(out, 0, N);
+    circleCollisionBatch(x, y, rad, N, otherX, otherY, otherRad, OTHERS, out);
+    if (out == got && memcmp(expected, got, N) != 0) {
+      printf("circle kernel %s differs from scalar\n", simdLevelName(level));
+      mismatches++;
+    }
+  }
+  setSimdLevel(best);
+
+  // expected still holds the scalar circle results
+  memset(got, 0, N);
+  buildEnemyGrid(&grid, otherX, otherY, otherRad, OTHERS);
+  circleCollisionGrid(x, y, rad, N, &grid, got);
+  if (memcmp(expected, got, N) != 0) {
+    printf("broadphase grid differs from scalar\n");
+    mismatches++;
+  }
+  return mismatches;
+}
+
+/*
+ * check circleCollision against a double precision reference, over random
+ * pairs of circles up to a few pixels apart, a quarter of them with one
+ * inside the other
+ * returns the number of pairs it gets wrong
+ */
+int checkReference(void) {
+  enum { PAIRS = 100000 };
+  int wrong = 0, truncatedWrong = 0;
+
+  rngState = 11;
+  for (int i = 0; i < PAIRS; i++) {
+    Vector2 a = randomPosition();
+    int radA = randomRange(1, 40);
+    int radB = randomRange(1, 40);
+    float reach = i % 4 == 0 ? abs(radA - radB) : radA + radB + 4;
+    Vector2 b = {a.x + randomRange(-reach, reach),
+                 a.y + randomRange(-reach, reach)};
+    double dx = (double)a.x - b.x;
+    double dy = (double)a.y - b.y;
+    double rads = radA + radB;
+    bool expected = dx * dx + dy * dy <= rads * rads;
+    wrong += circleCollision(a, b, radA, radB) != expected;
+    truncatedWrong += circleCollisionTruncated(a, b, radA, radB) != expected;
+  }
+  printf("circleCollision gets %d of %d pairs wrong against a double "
+         "precision reference, the old truncated test %d\n",
+         wrong, PAIRS, truncatedWrong);
+  return wrong;
+}
+
+/*
+ * fire fast bubbles through updateProjectiles, at the walls of a closed
+ * room and at enemies standing in their way, every other shot with one
+ * returns the number of shots that leave the room or get past an enemy
+ */
+int checkSwept(void) {
+  enum { SHOTS = 400 };
+  static Block blocks[MAX_BLOCKS];
+  static EnemiesContainer enemies;
+  static ProjectilesContainer pc;
+  char empty[TILES_X * TILES_Y + 1];
+  memset(empty, '0', TILES_X * TILES_Y);
+  empty[TILES_X * TILES_Y] = '\0';
+  makeRoomFromLayout(blocks, 0, 0, 0, 0, empty, RED);
+  if (pc.capacity == 0) {
+    initProjectiles(&pc, PROJECTILE_CAPACITY);
+  }
+  int escaped = 0, passed = 0, atEnemies = 0;
+
+  rngState = 13;
+  for (int i = 0; i < SHOTS; i++) {
+    Vector2 origin = randomPosition();
+    float speed = randomRange(40, 188);
+    float angle = randomRange(0, 2 * PI);
+    Vector2 dir = {cosf(angle), sinf(angle)};
+    // an enemy up to two steps ahead, where the bubble aims, if it fits
+    float ahead = randomRange(5 + STARTING_PLAYER_RADIUS + 1, 2 * speed);
+    Vector2 enemy = {origin.x + dir.x * ahead, origin.y + dir.y * ahead};
+    enemies.count = 0;
+    if (i % 2 == 1 && enemy.x > WALL_THICKNESS + STARTING_PLAYER_RADIUS &&
+        enemy.x < SCREEN_WIDTH - WALL_THICKNESS - STARTING_PLAYER_RADIUS &&
+        enemy.y > WALL_THICKNESS + STARTING_PLAYER_RADIUS &&
+        enemy.y < SCREEN_HEIGHT - WALL_THICKNESS - STARTING_PLAYER_RADIUS) {
+      spawnEnemy(&enemies, enemy, 1.0f, STARTING_PLAYER_RADIUS);
+      atEnemies++;
+    }
+
+    resetProjectiles(&pc);
+    shoot(dir.x * speed, dir.y * speed, origin, &pc);
+    bool out = false, through = false;
+    while (pc.count > 0) {
+      updateProjectiles(&pc, blocks, &enemies);
+      if (pc.count == 0) {
+        break;
+      }
+      out |= pc.x[0] < WALL_THICKNESS ||
+             pc.x[0] > SCREEN_WIDTH - WALL_THICKNESS ||
+             pc.y[0] < WALL_THICKNESS ||
+             pc.y[0] > SCREEN_HEIGHT - WALL_THICKNESS;
+      // beyond the enemy's centre along the line of fire
+      float along = (pc.x[0] - origin.x) * dir.x + (pc.y[0] - origin.y) * dir.y;
+      through |= enemies.count > 0 && along > ahead;
+    }
+    escaped += out;
+    passed += through;
+  }
+  printf("%d of %d fast shots left the room, %d of %d got past an enemy\n",
+         escaped, SHOTS, passed, atEnemies);
+  return escaped + passed;
+}
+
+/*
+ * time generating dungeons of up to 1600x1600 cells, over 10^6 rooms, single
+ * threaded and on the job system, and check that both give the same map
+ * returns the number of sizes where they differ
+ */
+int benchDungeon(const char *filter) {
+  int sizes[] = {100, 300, 1000, 1600};
+  int workers[] = {0, jobThreads() > 0 ? jobThreads() : 3};
+  int mismatches = 0;
+
+  printf("%-40s %12s %12s %12s\n", "case", "ms", "rooms", "rooms/sec");
+  for (int i = 0; i < 4; i++) {
+    DungeonParams params = {42, sizes[i], sizes[i]};
+    RoomPack packs[2];
+    for (int t = 0; t < 2; t++) {
+      char name[128];
+      snprintf(name, sizeof name, "generateDungeon/%dx%d/threads-%d",
+               sizes[i], sizes[i], workers[t] + 1);
+      JobSystem jobs;
+      initJobs(&jobs, workers[t]);
+      int runs = 0;
+      double total = 0;
+      while (runs < MIN_FRAMES && (runs == 0 || total < TIME_BUDGET)) {
+        if (runs > 0) {
+          unloadRoomPack(&packs[t]);
+        }
+        double start = monotonicTime();
+        packs[t] = generateDungeon(params, &jobs);
+        total += monotonicTime() - start;
+        runs++;
+      }
+      freeJobs(&jobs);
+
+      int rooms = packs[t].header.rooms;
+      if (!filter || strstr(name, filter)) {
+        double seconds = total / runs;
+        printf("%-40s %12.2f %12d %12.0f\n", name, seconds * 1e3, rooms,
+               rooms / seconds);
+      }
+    }
+    if (packs[0].size != packs[1].size ||
+        memcmp(packs[0].data, packs[1].data, packs[0].size) != 0) {
+      printf("dungeon %dx%d depends on the number of threads\n", sizes[i],
+             sizes[i]);
+      mismatches++;
+    }
+    unloadRoomPack(&packs[0]);
+    unloadRoomPack(&packs[1]);
+  }
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+
+  static Layout layouts[3] = {{"empty", ""}, {"test.txt", ""}, {"full", ""}};
+  memset(layouts[0].tiles, '0', TILES_X * TILES_Y);
+  readRoom("test.txt", layouts[1].tiles);
+  memset(layouts[2].tiles, '1', TILES_X * TILES_Y);
+  static Block blocks[MAX_BLOCKS];
+
+  SimdLevel best = getSimdLevel();
+  int mismatches = checkKernels(layouts, 3);
+  printf("simd level %s, batch kernels and broadphase %s the scalar path\n",
+         simdLevelName(best), mismatches ? "DO NOT MATCH" : "match");
+  mismatches += checkReference();
+  mismatches += checkSwept();
+
+  // the batch kernels run once per simd level
+  const char *fnNames[] = {"updatePos",
+                           "updateProjectiles",
+                           "blockCollision",
+                           "circleCollision",
+                           "circleCollisionTruncated",
+                           "blockCollisionBatch",
+                           "circleCollisionBatch",
+                           "enemyBroadphase",
+                           "moveEnemies"};
+  FrameFn fns[] = {frameUpdatePos,
+                   frameUpdateProjectiles,
+                   frameBlockCollision,
+                   frameCircleCollision,
+                   frameCircleCollisionTruncated,
+                   frameBlockCollisionBatch,
+                   frameCircleCollisionBatch,
+                   frameEnemyBroadphase,
+                   frameMoveEnemies};
+  bool perLevel[] = {false, false, false, false, false,
+                     true,  true,  false, false};
+  int counts[] = {50, 500, 5000};
+
+  printf("%-40s %12s %12s %12s %12s %12s\n", "case", "ns/frame", "frames/sec",
+         "p50 ns", "p90 ns", "p99 ns");
+  for (int f = 0; f < 9; f++) {
+    SimdLevel levels = perLevel[f] ? best : SIMD_SCALAR;
+    for (SimdLevel level = SIMD_SCALAR; level <= levels; level++) {
+      char name[64];
+      if (perLevel[f]) {
+        setSimdLevel(level);
+        snprintf(name, sizeof name, "%s-%s", fnNames[f], simdLevelName(level));
+      } else {
+        snprintf(name, sizeof name, "%s", fnNames[f]);
+      }
+      for (int l = 0; l < 3; l++) {
+        // doors on every side, like the middle room of the map
+        Room room =
+            makeRoomFromLayout(blocks, 1, 1, 1, 1, layouts[l].tiles, RED);
+        for (int c = 0; c < 3; c++) {
+          runCase(name, fns[f], &layouts[l], room, counts[c], filter);
+        }
+      }
+      setSimdLevel(best);
+    }
+  }
+  mismatches += benchDungeon(filter);
+  return mismatches != 0;
+}
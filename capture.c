@@ -0,0 +1,240 @@
+#include "capture.h"
+#include <sched.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_RGBA 0x1908
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_STREAM_READ 0x88E1
+#define GL_MAP_READ_BIT 0x0001
+
+/*
+ * the gl calls for pixel buffers, which raylib has no api for, looked up
+ * through the glfw that raylib is built with
+ */
+typedef void (*GLproc)(void);
+GLproc glfwGetProcAddress(const char *name);
+
+static struct {
+  void (*genBuffers)(int n, unsigned int *buffers);
+  void (*deleteBuffers)(int n, const unsigned int *buffers);
+  void (*bindBuffer)(unsigned int target, unsigned int buffer);
+  void (*bufferData)(unsigned int target, ptrdiff_t size, const void *data,
+                     unsigned int usage);
+  void *(*mapBufferRange)(unsigned int target, ptrdiff_t offset,
+                          ptrdiff_t length, unsigned int access);
+  unsigned char (*unmapBuffer)(unsigned int target);
+  void (*bindTexture)(unsigned int target, unsigned int texture);
+  void (*getTexImage)(unsigned int target, int level, unsigned int format,
+                      unsigned int type, void *pixels);
+} gl;
+
+void loadGl(void) {
+  gl.genBuffers = (void *)glfwGetProcAddress("glGenBuffers");
+  gl.deleteBuffers = (void *)glfwGetProcAddress("glDeleteBuffers");
+  gl.bindBuffer = (void *)glfwGetProcAddress("glBindBuffer");
+  gl.bufferData = (void *)glfwGetProcAddress("glBufferData");
+  gl.mapBufferRange = (void *)glfwGetProcAddress("glMapBufferRange");
+  gl.unmapBuffer = (void *)glfwGetProcAddress("glUnmapBuffer");
+  gl.bindTexture = (void *)glfwGetProcAddress("glBindTexture");
+  gl.getTexImage = (void *)glfwGetProcAddress("glGetTexImage");
+  if (gl.genBuffers == NULL || gl.mapBufferRange == NULL ||
+      gl.getTexImage == NULL) {
+    fprintf(stderr, "Failed loading pixel buffer calls for capture\n");
+    exit(1);
+  }
+}
+
+bool pushRing(CaptureRing *ring, int slot) {
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == CAPTURE_BUFFERS) {
+    return false;
+  }
+  ring->slots[tail % CAPTURE_BUFFERS] = slot;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// the oldest slot in the ring, or -1 if it is empty
+int popRing(CaptureRing *ring) {
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) {
+    return -1;
+  }
+  int slot = ring->slots[head % CAPTURE_BUFFERS];
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return slot;
+}
+
+/*
+ * convert a frame to BT.601 YUV 4:2:0 and append it to the file repeats
+ * times, the chroma of each 2x2 block is taken from its average colour
+ */
+void writeFrame(FrameCapture *capture, const unsigned char *rgba,
+                int repeats) {
+  int w = capture->width, h = capture->height;
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  unsigned char *lumaPlane = capture->yuv;
+  unsigned char *uPlane = lumaPlane + w * h;
+  unsigned char *vPlane = uPlane + cw * ch;
+
+  for (int y = 0; y < h; y++) {
+    // the texture comes bottom row first
+    const unsigned char *row = rgba + (size_t)(h - 1 - y) * w * 4;
+    for (int x = 0; x < w; x++) {
+      int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+      lumaPlane[y * w + x] = (66 * r + 129 * g + 25 * b + 128) / 256 + 16;
+    }
+  }
+  for (int y = 0; y < ch; y++) {
+    for (int x = 0; x < cw; x++) {
+      int r = 0, g = 0, b = 0, n = 0;
+      for (int dy = 0; dy < 2 && 2 * y + dy < h; dy++) {
+        const unsigned char *row = rgba + (size_t)(h - 1 - 2 * y - dy) * w * 4;
+        for (int dx = 0; dx < 2 && 2 * x + dx < w; dx++) {
+          const unsigned char *p = row + (2 * x + dx) * 4;
+          r += p[0];
+          g += p[1];
+          b += p[2];
+          n++;
+        }
+      }
+      r /= n;
+      g /= n;
+      b /= n;
+      uPlane[y * cw + x] = (-38 * r - 74 * g + 112 * b + 128) / 256 + 128;
+      vPlane[y * cw + x] = (112 * r - 94 * g - 18 * b + 128) / 256 + 128;
+    }
+  }
+  for (int i = 0; i < repeats; i++) {
+    fputs("FRAME\n", capture->file);
+    fwrite(capture->yuv, 1, w * h + 2 * cw * ch, capture->file);
+  }
+}
+
+void *captureWriter(void *arg) {
+  FrameCapture *capture = arg;
+  for (;;) {
+    sem_wait(&capture->ready);
+    int slot = popRing(&capture->filled);
+    if (slot >= 0) {
+      writeFrame(capture, capture->buffers[slot], capture->repeats[slot]);
+      pushRing(&capture->free, slot);
+    } else if (atomic_load(&capture->quit)) {
+      // every frame posted before quit has been written
+      return NULL;
+    }
+  }
+}
+
+void openCapture(FrameCapture *capture, const char *path, int width,
+                 int height, int fps) {
+  *capture = (FrameCapture){0};
+  capture->file = fopen(path, "wb");
+  if (capture->file == NULL) {
+    perror("Failed opening capture");
+    exit(1);
+  }
+  capture->width = width;
+  capture->height = height;
+  fprintf(capture->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width,
+          height, fps);
+
+  // everything is allocated up front, nothing is while capturing
+  int cw = (width + 1) / 2, ch = (height + 1) / 2;
+  capture->yuv = malloc(width * height + 2 * cw * ch);
+  for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+    capture->buffers[i] = malloc((size_t)width * height * 4);
+    pushRing(&capture->free, i);
+  }
+  loadGl();
+  gl.genBuffers(CAPTURE_PIXEL_BUFFERS, capture->pixelBuffers);
+  for (int i = 0; i < CAPTURE_PIXEL_BUFFERS; i++) {
+    gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture->pixelBuffers[i]);
+    gl.bufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)width * height * 4, NULL,
+                  GL_STREAM_READ);
+  }
+  gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  sem_init(&capture->ready, 0, 0);
+  if (pthread_create(&capture->writer, NULL, captureWriter, capture) != 0) {
+    perror("Failed starting capture thread");
+    exit(1);
+  }
+}
+
+/*
+ * map pixel buffer i, copy its frame into a free buffer and queue it
+ * if the writer is behind, the frame is dropped unless told to wait for it
+ */
+void readBack(FrameCapture *capture, int i, bool wait) {
+  size_t size = (size_t)capture->width * capture->height * 4;
+  int repeats = capture->pending[i];
+  capture->pending[i] = 0;
+  gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture->pixelBuffers[i]);
+  const void *pixels =
+      gl.mapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  int slot = popRing(&capture->free);
+  while (slot < 0 && wait) {
+    sched_yield();
+    slot = popRing(&capture->free);
+  }
+  if (slot < 0 || pixels == NULL) {
+    capture->dropped += repeats;
+  } else {
+    memcpy(capture->buffers[slot], pixels, size);
+    capture->repeats[slot] = repeats;
+    pushRing(&capture->filled, slot);
+    sem_post(&capture->ready);
+    capture->captured += repeats;
+  }
+  if (pixels != NULL) {
+    gl.unmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void captureFrame(FrameCapture *capture, Texture2D texture, int repeats) {
+  int i = capture->requested % CAPTURE_PIXEL_BUFFERS;
+  // the frame copied into this buffer CAPTURE_PIXEL_BUFFERS frames ago
+  if (capture->pending[i] > 0) {
+    readBack(capture, i, false);
+  }
+  // with a pack buffer bound this only queues the copy, it does not wait
+  gl.bindTexture(GL_TEXTURE_2D, texture.id);
+  gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture->pixelBuffers[i]);
+  gl.getTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  gl.bindTexture(GL_TEXTURE_2D, 0);
+  capture->pending[i] = repeats;
+  capture->requested++;
+}
+
+void closeCapture(FrameCapture *capture) {
+  // the copies not mapped yet, oldest first
+  long end = capture->requested + CAPTURE_PIXEL_BUFFERS;
+  for (long k = capture->requested; k < end; k++) {
+    int i = k % CAPTURE_PIXEL_BUFFERS;
+    if (capture->pending[i] > 0) {
+      readBack(capture, i, true);
+    }
+  }
+  gl.deleteBuffers(CAPTURE_PIXEL_BUFFERS, capture->pixelBuffers);
+  atomic_store(&capture->quit, true);
+  sem_post(&capture->ready);
+  pthread_join(capture->writer, NULL);
+  sem_destroy(&capture->ready);
+  if (fclose(capture->file) != 0) {
+    perror("Failed writing capture");
+  }
+  printf("captured %ld frames, dropped %ld\n", capture->captured,
+         capture->dropped);
+  for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+    free(capture->buffers[i]);
+  }
+  free(capture->yuv);
+}
@@ -0,0 +1,70 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "raylib.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// frames that can be waiting for the disk, a power of two
+#define CAPTURE_BUFFERS 8
+/*
+ * frames the gpu copies into pixel buffers before they are mapped, so the
+ * mapping is of a frame the gpu finished a few frames ago instead of
+ * waiting for the one just drawn
+ */
+#define CAPTURE_PIXEL_BUFFERS 3
+
+/*
+ * single producer, single consumer ring of buffer indices
+ * only the producer moves tail and only the consumer moves head
+ */
+typedef struct CaptureRing {
+  int slots[CAPTURE_BUFFERS];
+  atomic_uint head;
+  atomic_uint tail;
+} CaptureRing;
+
+/*
+ * frames copied into a ring of pixel buffers on the gpu, mapped into a
+ * fixed pool of buffers CAPTURE_PIXEL_BUFFERS frames later, and written to
+ * a Y4M file by a thread of its own
+ * buffers go from the free ring to the filled ring and back, when there is
+ * no free one the frame is dropped instead of waiting for the disk
+ */
+typedef struct FrameCapture {
+  FILE *file;
+  int width;
+  int height;
+  unsigned int pixelBuffers[CAPTURE_PIXEL_BUFFERS];
+  int pending[CAPTURE_PIXEL_BUFFERS]; // repeats of the frame in each, or 0
+  long requested; // frames copied, the next goes to requested % N
+  unsigned char *buffers[CAPTURE_BUFFERS]; // RGBA, bottom row first
+  int repeats[CAPTURE_BUFFERS];            // times to write each frame
+  unsigned char *yuv;                      // the writer's frame in YUV 4:2:0
+  CaptureRing free;
+  CaptureRing filled;
+  sem_t ready; // posted for every filled buffer, and to quit
+  atomic_bool quit;
+  pthread_t writer;
+  long captured; // frames written, repeats included
+  long dropped;
+} FrameCapture;
+
+/*
+ * fps is written in the file header, a frame has to be written for each
+ * needs the window's gl context to be current
+ */
+void openCapture(FrameCapture *capture, const char *path, int width,
+                 int height, int fps);
+/*
+ * queue a copy of the texture on the gpu, to be written repeats times, then
+ * map the oldest copy and queue it for the writer, or drop it if the
+ * writer is behind
+ */
+void captureFrame(FrameCapture *capture, Texture2D texture, int repeats);
+// map and write what is pending, then close the file
+void closeCapture(FrameCapture *capture);
+
+#endif
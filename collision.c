@@ -0,0 +1,452 @@
+#include "collision.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * swept version of blockCollision, for a circle moving from pos to
+ * pos + move
+ * returns the fraction of the move (0 to 1) at which it first touches the
+ * block grown by rad, with square corners like blockCollision, or -1 when
+ * it does not touch it during the move
+ */
+float sweptBlockCollision(Block block, Vector2 pos, Vector2 move, int rad) {
+  float bStartX = block.start.x;
+  float bStartY = block.start.y;
+  float bEndX = block.start.x + block.size.x;
+  float bEndY = block.start.y + block.size.y;
+  float lo[2] = {bStartX - rad, bStartY - rad};
+  float hi[2] = {bEndX + rad, bEndY + rad};
+  float p[2] = {pos.x, pos.y};
+  float m[2] = {move.x, move.y};
+
+  // the part of the move inside both slabs of the grown block
+  float tEnter = 0;
+  float tExit = 1;
+  for (int axis = 0; axis < 2; axis++) {
+    if (m[axis] == 0) {
+      if (p[axis] <= lo[axis] || p[axis] >= hi[axis]) {
+        return -1;
+      }
+      continue;
+    }
+    float t0 = (lo[axis] - p[axis]) / m[axis];
+    float t1 = (hi[axis] - p[axis]) / m[axis];
+    if (t0 > t1) {
+      float t = t0;
+      t0 = t1;
+      t1 = t;
+    }
+    tEnter = fmaxf(tEnter, t0);
+    tExit = fminf(tExit, t1);
+  }
+  return tEnter < tExit ? tEnter : -1;
+}
+
+/*
+ * swept circle test, for circle 1 moving from pos1 to pos1 + move while
+ * circle 2 stands still
+ * returns the fraction of the move (0 to 1) at which they first touch, 0
+ * if they already overlap, or -1 when they do not touch during the move
+ */
+float sweptCircleCollision(Vector2 pos1, Vector2 move, Vector2 pos2, int rad1,
+                           int rad2) {
+  float dx = pos1.x - pos2.x;
+  float dy = pos1.y - pos2.y;
+  float rads = rad1 + rad2;
+  float c = dx * dx + dy * dy - rads * rads;
+  if (c <= 0) {
+    return 0;
+  }
+  // |d + move * t| = rads, a t^2 + 2 b t + c = 0
+  float a = move.x * move.x + move.y * move.y;
+  float b = dx * move.x + dy * move.y;
+  if (a == 0 || b >= 0) {
+    // not moving, or moving away
+    return -1;
+  }
+  float disc = b * b - a * c;
+  if (disc < 0) {
+    return -1;
+  }
+  float t = (-b - sqrtf(disc)) / a;
+  return t <= 1 ? t : -1;
+}
+
+// bounds of the enabled blocks only, returns how many
+int blockBounds(const Block *blocks, int nBlocks, float *startX,
+                float *startY, float *endX, float *endY) {
+  int n = 0;
+  for (int i = 0; i < nBlocks; i++) {
+    Block b = blocks[i];
+    if (b.enabled) {
+      startX[n] = b.start.x;
+      startY[n] = b.start.y;
+      endX[n] = b.start.x + b.size.x;
+      endY[n] = b.start.y + b.size.y;
+      n++;
+    }
+  }
+  return n;
+}
+
+void blockCollisionScalar(const float *x, const float *y, const int *rad,
+                          int n, const Block *blocks, int nBlocks,
+                          unsigned char *hit) {
+  for (int i = 0; i < n; i++) {
+    Vector2 pos = {x[i], y[i]};
+    for (int j = 0; j < nBlocks && !hit[i]; j++) {
+      if (blocks[j].enabled) {
+        Vector2 collision = blockCollision(blocks[j], pos, rad[i]);
+        hit[i] = collision.x && collision.y;
+      }
+    }
+  }
+}
+
+void circleCollisionScalar(const float *x, const float *y, const int *rad,
+                           int n, const float *otherX, const float *otherY,
+                           const int *otherRad, int nOther,
+                           unsigned char *hit) {
+  for (int i = 0; i < n; i++) {
+    Vector2 pos = {x[i], y[i]};
+    for (int j = 0; j < nOther && !hit[i]; j++) {
+      Vector2 other = {otherX[j], otherY[j]};
+      hit[i] = circleCollision(pos, other, rad[i], otherRad[j]);
+    }
+  }
+}
+
+// grid cell of a coordinate, clamped so everything off the grid lands on
+// the edge cells
+int gridCell(float v, int cells) {
+  int c = floorf(v / GRID_CELL_SIZE);
+  return c < 0 ? 0 : c >= cells ? cells - 1 : c;
+}
+
+void buildEnemyGrid(EnemyGrid *grid, const float *x, const float *y,
+                    const int *rad, int n) {
+  int cells = GRID_W * GRID_H;
+  int cellOf[MAX_ENEMIES];
+  memset(grid->cellStart, 0, sizeof grid->cellStart);
+  grid->count = n;
+  grid->maxRad = 0;
+
+  // count the enemies per cell, then turn the counts into start offsets
+  for (int i = 0; i < n; i++) {
+    cellOf[i] = gridCell(y[i], GRID_H) * GRID_W + gridCell(x[i], GRID_W);
+    grid->cellStart[cellOf[i] + 1]++;
+    grid->maxRad = rad[i] > grid->maxRad ? rad[i] : grid->maxRad;
+  }
+  for (int c = 0; c < cells; c++) {
+    grid->cellStart[c + 1] += grid->cellStart[c];
+  }
+  int next[GRID_W * GRID_H];
+  memcpy(next, grid->cellStart, sizeof next);
+  for (int i = 0; i < n; i++) {
+    int j = next[cellOf[i]]++;
+    grid->x[j] = x[i];
+    grid->y[j] = y[i];
+    grid->rad[j] = rad[i];
+  }
+}
+
+void circleCollisionGrid(const float *x, const float *y, const int *rad, int n,
+                         const EnemyGrid *grid, unsigned char *hit) {
+  for (int i = 0; i < n; i++) {
+    if (hit[i]) {
+      continue;
+    }
+    int reach = rad[i] + grid->maxRad;
+    int startX = gridCell(x[i] - reach, GRID_W);
+    int endX = gridCell(x[i] + reach, GRID_W);
+    int startY = gridCell(y[i] - reach, GRID_H);
+    int endY = gridCell(y[i] + reach, GRID_H);
+    Vector2 pos = {x[i], y[i]};
+
+    for (int cy = startY; cy <= endY && !hit[i]; cy++) {
+      int first = grid->cellStart[cy * GRID_W + startX];
+      int last = grid->cellStart[cy * GRID_W + endX + 1];
+      for (int j = first; j < last; j++) {
+        Vector2 other = {grid->x[j], grid->y[j]};
+        if (circleCollision(pos, other, rad[i], grid->rad[j])) {
+          hit[i] = 1;
+          break;
+        }
+      }
+    }
+  }
+}
+
+#ifdef HAVE_X86
+/*
+ * the kernels below test "lanes" circles at a time, mask has a bit set for
+ * each lane that already hit something, which is skipped
+ * they return the mask with the new hits added
+ */
+typedef int (*BlockChunkFn)(const float *x, const float *y, const int *rad,
+                            int mask, const float *startX,
+                            const float *startY, const float *endX,
+                            const float *endY, int m);
+typedef int (*CircleChunkFn)(const float *x, const float *y, const int *rad,
+                             int mask, const float *otherX,
+                             const float *otherY, const int *otherRad,
+                             int nOther);
+
+int blockChunkSse2(const float *x, const float *y, const int *rad, int mask,
+                   const float *startX, const float *startY,
+                   const float *endX, const float *endY, int m) {
+  __m128 px = _mm_loadu_ps(x);
+  __m128 py = _mm_loadu_ps(y);
+  __m128 r = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)rad));
+  for (int j = 0; j < m && mask != 0xf; j++) {
+    // pos.x < bEndX + rad && pos.x > bStartX - rad, same for y
+    __m128 hiX = _mm_add_ps(_mm_set1_ps(endX[j]), r);
+    __m128 loX = _mm_sub_ps(_mm_set1_ps(startX[j]), r);
+    __m128 hiY = _mm_add_ps(_mm_set1_ps(endY[j]), r);
+    __m128 loY = _mm_sub_ps(_mm_set1_ps(startY[j]), r);
+    __m128 inX = _mm_and_ps(_mm_cmplt_ps(px, hiX), _mm_cmpgt_ps(px, loX));
+    __m128 inY = _mm_and_ps(_mm_cmplt_ps(py, hiY), _mm_cmpgt_ps(py, loY));
+    mask |= _mm_movemask_ps(_mm_and_ps(inX, inY));
+  }
+  return mask;
+}
+
+int circleChunkSse2(const float *x, const float *y, const int *rad, int mask,
+                    const float *otherX, const float *otherY,
+                    const int *otherRad, int nOther) {
+  __m128 px = _mm_loadu_ps(x);
+  __m128 py = _mm_loadu_ps(y);
+  __m128i r = _mm_loadu_si128((const __m128i *)rad);
+  for (int j = 0; j < nOther && mask != 0xf; j++) {
+    // dx * dx + dy * dy <= rads * rads
+    __m128 rads =
+        _mm_cvtepi32_ps(_mm_add_epi32(r, _mm_set1_epi32(otherRad[j])));
+    __m128 dx = _mm_sub_ps(px, _mm_set1_ps(otherX[j]));
+    __m128 dy = _mm_sub_ps(py, _mm_set1_ps(otherY[j]));
+    __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    mask |= _mm_movemask_ps(_mm_cmple_ps(dist, _mm_mul_ps(rads, rads)));
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) int
+blockChunkAvx2(const float *x, const float *y, const int *rad, int mask,
+               const float *startX, const float *startY, const float *endX,
+               const float *endY, int m) {
+  __m256 px = _mm256_loadu_ps(x);
+  __m256 py = _mm256_loadu_ps(y);
+  __m256 r = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)rad));
+  for (int j = 0; j < m && mask != 0xff; j++) {
+    __m256 hiX = _mm256_add_ps(_mm256_set1_ps(endX[j]), r);
+    __m256 loX = _mm256_sub_ps(_mm256_set1_ps(startX[j]), r);
+    __m256 hiY = _mm256_add_ps(_mm256_set1_ps(endY[j]), r);
+    __m256 loY = _mm256_sub_ps(_mm256_set1_ps(startY[j]), r);
+    __m256 inX = _mm256_and_ps(_mm256_cmp_ps(px, hiX, _CMP_LT_OQ),
+                               _mm256_cmp_ps(px, loX, _CMP_GT_OQ));
+    __m256 inY = _mm256_and_ps(_mm256_cmp_ps(py, hiY, _CMP_LT_OQ),
+                               _mm256_cmp_ps(py, loY, _CMP_GT_OQ));
+    mask |= _mm256_movemask_ps(_mm256_and_ps(inX, inY));
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) int
+circleChunkAvx2(const float *x, const float *y, const int *rad, int mask,
+                const float *otherX, const float *otherY, const int *otherRad,
+                int nOther) {
+  __m256 px = _mm256_loadu_ps(x);
+  __m256 py = _mm256_loadu_ps(y);
+  __m256i r = _mm256_loadu_si256((const __m256i *)rad);
+  for (int j = 0; j < nOther && mask != 0xff; j++) {
+    __m256 rads = _mm256_cvtepi32_ps(
+        _mm256_add_epi32(r, _mm256_set1_epi32(otherRad[j])));
+    __m256 dx = _mm256_sub_ps(px, _mm256_set1_ps(otherX[j]));
+    __m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(otherY[j]));
+    __m256 dist =
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    __m256 inside =
+        _mm256_cmp_ps(dist, _mm256_mul_ps(rads, rads), _CMP_LE_OQ);
+    mask |= _mm256_movemask_ps(inside);
+  }
+  return mask;
+}
+
+/*
+ * run a chunk kernel over all n circles, the last partial chunk is padded,
+ * with the padding lanes marked as hit so they are skipped
+ */
+void blockCollisionChunked(BlockChunkFn chunk, int lanes, const float *x,
+                           const float *y, const int *rad, int n,
+                           const Block *blocks, int nBlocks,
+                           unsigned char *hit) {
+  float startX[MAX_BLOCKS], startY[MAX_BLOCKS], endX[MAX_BLOCKS],
+      endY[MAX_BLOCKS];
+  if (nBlocks > MAX_BLOCKS) {
+    blockCollisionScalar(x, y, rad, n, blocks, nBlocks, hit);
+    return;
+  }
+  int m = blockBounds(blocks, nBlocks, startX, startY, endX, endY);
+
+  for (int i = 0; i < n; i += lanes) {
+    float padX[8] = {0}, padY[8] = {0};
+    int padRad[8] = {0};
+    int valid = n - i < lanes ? n - i : lanes;
+    const float *cx = x + i, *cy = y + i;
+    const int *cr = rad + i;
+    if (valid < lanes) {
+      memcpy(padX, cx, valid * sizeof *padX);
+      memcpy(padY, cy, valid * sizeof *padY);
+      memcpy(padRad, cr, valid * sizeof *padRad);
+      cx = padX;
+      cy = padY;
+      cr = padRad;
+    }
+    int mask = ~((1 << valid) - 1) & ((1 << lanes) - 1);
+    for (int k = 0; k < valid; k++) {
+      mask |= (hit[i + k] != 0) << k;
+    }
+    mask = chunk(cx, cy, cr, mask, startX, startY, endX, endY, m);
+    for (int k = 0; k < valid; k++) {
+      hit[i + k] = (mask >> k) & 1;
+    }
+  }
+}
+
+void circleCollisionChunked(CircleChunkFn chunk, int lanes, const float *x,
+                            const float *y, const int *rad, int n,
+                            const float *otherX, const float *otherY,
+                            const int *otherRad, int nOther,
+                            unsigned char *hit) {
+  for (int i = 0; i < n; i += lanes) {
+    float padX[8] = {0}, padY[8] = {0};
+    int padRad[8] = {0};
+    int valid = n - i < lanes ? n - i : lanes;
+    const float *cx = x + i, *cy = y + i;
+    const int *cr = rad + i;
+    if (valid < lanes) {
+      memcpy(padX, cx, valid * sizeof *padX);
+      memcpy(padY, cy, valid * sizeof *padY);
+      memcpy(padRad, cr, valid * sizeof *padRad);
+      cx = padX;
+      cy = padY;
+      cr = padRad;
+    }
+    int mask = ~((1 << valid) - 1) & ((1 << lanes) - 1);
+    for (int k = 0; k < valid; k++) {
+      mask |= (hit[i + k] != 0) << k;
+    }
+    mask = chunk(cx, cy, cr, mask, otherX, otherY, otherRad, nOther);
+    for (int k = 0; k < valid; k++) {
+      hit[i + k] = (mask >> k) & 1;
+    }
+  }
+}
+
+void blockCollisionSse2(const float *x, const float *y, const int *rad, int n,
+                        const Block *blocks, int nBlocks, unsigned char *hit) {
+  blockCollisionChunked(blockChunkSse2, 4, x, y, rad, n, blocks, nBlocks, hit);
+}
+
+void circleCollisionSse2(const float *x, const float *y, const int *rad, int n,
+                         const float *otherX, const float *otherY,
+                         const int *otherRad, int nOther, unsigned char *hit) {
+  circleCollisionChunked(circleChunkSse2, 4, x, y, rad, n, otherX, otherY,
+                         otherRad, nOther, hit);
+}
+
+void blockCollisionAvx2(const float *x, const float *y, const int *rad, int n,
+                        const Block *blocks, int nBlocks, unsigned char *hit) {
+  blockCollisionChunked(blockChunkAvx2, 8, x, y, rad, n, blocks, nBlocks, hit);
+}
+
+void circleCollisionAvx2(const float *x, const float *y, const int *rad, int n,
+                         const float *otherX, const float *otherY,
+                         const int *otherRad, int nOther, unsigned char *hit) {
+  circleCollisionChunked(circleChunkAvx2, 8, x, y, rad, n, otherX, otherY,
+                         otherRad, nOther, hit);
+}
+#endif
+
+typedef void (*BlockBatchFn)(const float *, const float *, const int *, int,
+                             const Block *, int, unsigned char *);
+typedef void (*CircleBatchFn)(const float *, const float *, const int *, int,
+                              const float *, const float *, const int *, int,
+                              unsigned char *);
+
+static pthread_once_t simdOnce = PTHREAD_ONCE_INIT;
+static int simdLevel = SIMD_SCALAR;
+static BlockBatchFn blockBatch = blockCollisionScalar;
+static CircleBatchFn circleBatch = circleCollisionScalar;
+
+SimdLevel supportedSimdLevel(void) {
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SIMD_SSE2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+const char *simdLevelName(SimdLevel level) {
+  const char *names[] = {"scalar", "sse2", "avx2"};
+  return names[level];
+}
+
+SimdLevel setSimdLevel(SimdLevel level) {
+  SimdLevel supported = supportedSimdLevel();
+  simdLevel = level < supported ? level : supported;
+  blockBatch = blockCollisionScalar;
+  circleBatch = circleCollisionScalar;
+#ifdef HAVE_X86
+  if (simdLevel == SIMD_SSE2) {
+    blockBatch = blockCollisionSse2;
+    circleBatch = circleCollisionSse2;
+  } else if (simdLevel == SIMD_AVX2) {
+    blockBatch = blockCollisionAvx2;
+    circleBatch = circleCollisionAvx2;
+  }
+#endif
+  return simdLevel;
+}
+
+// the best supported level, or the one SPRUTTE_SIMD asks for
+void resolveSimdLevel(void) {
+  SimdLevel level = SIMD_AVX2;
+  const char *env = getenv("SPRUTTE_SIMD");
+  if (env) {
+    for (int i = SIMD_SCALAR; i <= SIMD_AVX2; i++) {
+      if (strcmp(env, simdLevelName(i)) == 0) {
+        level = i;
+      }
+    }
+  }
+  setSimdLevel(level);
+}
+
+SimdLevel getSimdLevel(void) {
+  pthread_once(&simdOnce, resolveSimdLevel);
+  return simdLevel;
+}
+
+void blockCollisionBatch(const float *x, const float *y, const int *rad,
+                         int n, const Block *blocks, int nBlocks,
+                         unsigned char *hit) {
+  blockBatch(x, y, rad, n, blocks, nBlocks, hit);
+}
+
+void circleCollisionBatch(const float *x, const float *y, const int *rad,
+                          int n, const float *otherX, const float *otherY,
+                          const int *otherRad, int nOther, unsigned char *hit) {
+  circleBatch(x, y, rad, n, otherX, otherY, otherRad, nOther, hit);
+}
@@ -0,0 +1,96 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "game.h"
+
+// broadphase grid over the room, one cell per tile plus one for the walls
+#define GRID_CELL_SIZE BLOCK_SIZE
+#define GRID_W (TILES_X + 1)
+#define GRID_H (TILES_Y + 1)
+// below this many enemies testing all of them is cheaper than the grid
+#define BROADPHASE_MIN_ENEMIES 16
+
+/*
+ * uniform grid over the live enemies, rebuilt every frame
+ * enemies are sorted by cell, so the enemies of a row of cells are next to
+ * each other, from cellStart[first cell] up to cellStart[last cell + 1]
+ */
+typedef struct EnemyGrid {
+  int cellStart[GRID_W * GRID_H + 1];
+  float x[MAX_ENEMIES];
+  float y[MAX_ENEMIES];
+  int rad[MAX_ENEMIES];
+  int count;
+  int maxRad;
+} EnemyGrid;
+
+// instruction sets the batch collision kernels can use
+typedef enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 } SimdLevel;
+
+/*
+ * check for collision with blocks
+ * returns a boolean Vector2 for collision on x and y
+ */
+static inline Vector2 blockCollision(Block block, Vector2 pos, int rad) {
+  float bStartX = block.start.x;
+  float bStartY = block.start.y;
+  float bEndX = block.start.x + block.size.x;
+  float bEndY = block.start.y + block.size.y;
+
+  bool posInsideXInterval = pos.x < bEndX + rad && pos.x > bStartX - rad;
+  bool posInsideYInterval = pos.y < bEndY + rad && pos.y > bStartY - rad;
+
+  return (Vector2){posInsideXInterval, posInsideYInterval};
+}
+
+/*
+ * circles collide when the distance between the centres is at most the sum
+ * of the radii, which includes one circle lying inside the other
+ */
+static inline bool circleCollision(Vector2 pos1, Vector2 pos2, int rad1,
+                                   int rad2) {
+  float dx = pos1.x - pos2.x;
+  float dy = pos1.y - pos2.y;
+  float rads = rad1 + rad2;
+
+  return dx * dx + dy * dy <= rads * rads;
+}
+
+float sweptBlockCollision(Block block, Vector2 pos, Vector2 move, int rad);
+float sweptCircleCollision(Vector2 pos1, Vector2 move, Vector2 pos2, int rad1,
+                           int rad2);
+
+/*
+ * batch versions of the tests above, for n circles given as arrays of
+ * x, y and radius
+ * hit[i] is set to 1 when circle i collides with any of the enabled blocks
+ * (or circles), and left alone otherwise, so several passes can share it
+ * the results are exactly those of blockCollision and circleCollision
+ */
+void blockCollisionBatch(const float *x, const float *y, const int *rad,
+                         int n, const Block *blocks, int nBlocks,
+                         unsigned char *hit);
+void circleCollisionBatch(const float *x, const float *y, const int *rad,
+                          int n, const float *otherX, const float *otherY,
+                          const int *otherRad, int nOther, unsigned char *hit);
+
+void buildEnemyGrid(EnemyGrid *grid, const float *x, const float *y,
+                    const int *rad, int n);
+// like circleCollisionBatch, against the enemies in the grid
+void circleCollisionGrid(const float *x, const float *y, const int *rad, int n,
+                         const EnemyGrid *grid, unsigned char *hit);
+
+/*
+ * the best level the cpu supports is picked by the first getSimdLevel,
+ * unless the SPRUTTE_SIMD environment variable is set to scalar, sse2 or
+ * avx2, and the batch kernels run the scalar code until then
+ * gameInit calls it before any job thread starts, the batch kernels only
+ * read the level
+ * setSimdLevel lowers it to the given level, if supported, and must not
+ * run while other threads use the kernels
+ */
+SimdLevel getSimdLevel(void);
+SimdLevel setSimdLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+#endif
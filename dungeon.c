@@ -0,0 +1,328 @@
+#include "dungeon.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_CELLS (DUNGEON_SECTOR * DUNGEON_SECTOR)
+// set on the cells of a sector that hold a room, next to the DOOR_* bits
+#define CELL_ROOM (1 << 7)
+
+// what each hash of a sector is used for
+enum {
+  SALT_HUB,         // the cell its corridors start from
+  SALT_UP_OR_LEFT,  // which neighbouring sector it is linked to
+  SALT_GATE_UP,     // where the link to the sector above crosses
+  SALT_GATE_LEFT,   // where the link to the sector on the left crosses
+  SALT_ROOMS        // everything else
+};
+
+// one sector being generated, in cells relative to its corner
+typedef struct Sector {
+  int x0, y0;
+  int w, h;
+  uint64_t rng;
+  unsigned char flags[SECTOR_CELLS]; // CELL_ROOM and the DOOR_* bits
+  bool corridor[SECTOR_CELLS];
+  int rooms[SECTOR_CELLS];
+  int count;
+  int first; // index in the pack of its first room
+} Sector;
+
+// what the jobs generating the sectors share
+typedef struct DungeonJob {
+  const DungeonParams *params;
+  Sector *sectors;
+  RoomPack *pack;
+} DungeonJob;
+
+// splitmix64 finalizer
+uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t nextRandom(uint64_t *state) {
+  *state += 0x9e3779b97f4a7c15ULL;
+  return mix64(*state);
+}
+
+// random number below n
+int randomBelow(uint64_t *state, int n) { return nextRandom(state) % n; }
+
+// hash of one decision about a sector, the same whichever thread asks
+uint64_t sectorHash(uint64_t seed, int sx, int sy, int salt) {
+  uint64_t key = ((uint64_t)sx << 32 | (uint32_t)sy) * 8 + salt;
+  return mix64(seed ^ mix64(key + 0x9e3779b97f4a7c15ULL));
+}
+
+int sectorsX(const DungeonParams *p) {
+  return (p->width + DUNGEON_SECTOR - 1) / DUNGEON_SECTOR;
+}
+
+int sectorsY(const DungeonParams *p) {
+  return (p->height + DUNGEON_SECTOR - 1) / DUNGEON_SECTOR;
+}
+
+int sectorWidth(const DungeonParams *p, int sx) {
+  int left = p->width - sx * DUNGEON_SECTOR;
+  return left < DUNGEON_SECTOR ? left : DUNGEON_SECTOR;
+}
+
+int sectorHeight(const DungeonParams *p, int sy) {
+  int left = p->height - sy * DUNGEON_SECTOR;
+  return left < DUNGEON_SECTOR ? left : DUNGEON_SECTOR;
+}
+
+/*
+ * the sectors form a tree, each one is linked to the sector above or the
+ * one on its left, so every room can be reached from every other
+ */
+bool linkedUp(const DungeonParams *p, int sx, int sy) {
+  if (sy == 0) {
+    return false;
+  }
+  return sx == 0 || (sectorHash(p->seed, sx, sy, SALT_UP_OR_LEFT) & 1);
+}
+
+bool linkedLeft(const DungeonParams *p, int sx, int sy) {
+  if (sx == 0) {
+    return false;
+  }
+  return sy == 0 || !(sectorHash(p->seed, sx, sy, SALT_UP_OR_LEFT) & 1);
+}
+
+// the cell in a sector that its corridors start from
+int sectorHub(const DungeonParams *p, int sx, int sy) {
+  int cells = sectorWidth(p, sx) * sectorHeight(p, sy);
+  return sectorHash(p->seed, sx, sy, SALT_HUB) % cells;
+}
+
+// add a cell to the rooms of the sector, if it is not one yet
+void addRoom(Sector *s, int cell, bool corridor) {
+  if (!(s->flags[cell] & CELL_ROOM)) {
+    s->flags[cell] = CELL_ROOM;
+    s->corridor[cell] = corridor;
+    s->rooms[s->count++] = cell;
+  }
+}
+
+// put doors between two neighbouring cells
+void linkCells(Sector *s, int a, int b) {
+  if (b == a - s->w) {
+    s->flags[a] |= DOOR_UP;
+    s->flags[b] |= DOOR_DOWN;
+  } else if (b == a + s->w) {
+    s->flags[a] |= DOOR_DOWN;
+    s->flags[b] |= DOOR_UP;
+  } else if (b == a - 1) {
+    s->flags[a] |= DOOR_LEFT;
+    s->flags[b] |= DOOR_RIGHT;
+  } else {
+    s->flags[a] |= DOOR_RIGHT;
+    s->flags[b] |= DOOR_LEFT;
+  }
+}
+
+// a winding corridor of rooms from one cell to another
+void carveCorridor(Sector *s, int from, int to) {
+  int x = from % s->w, y = from / s->w;
+  int tx = to % s->w, ty = to / s->w;
+  while (x != tx || y != ty) {
+    int cell = y * s->w + x;
+    if (x != tx && (y == ty || randomBelow(&s->rng, 2))) {
+      x += x < tx ? 1 : -1;
+    } else {
+      y += y < ty ? 1 : -1;
+    }
+    addRoom(s, y * s->w + x, true);
+    linkCells(s, cell, y * s->w + x);
+  }
+}
+
+// carve a corridor from the hub to where a link to another sector crosses
+void addGate(Sector *s, int hub, int x, int y, unsigned char door) {
+  int cell = y * s->w + x;
+  carveCorridor(s, hub, cell);
+  s->flags[cell] |= door;
+}
+
+// branch side rooms off the ones there are, and close a few loops
+void growRooms(Sector *s) {
+  int cells = s->w * s->h;
+  int target = cells * (30 + randomBelow(&s->rng, 30)) / 100;
+  for (int tries = 0; s->count < target && tries < cells * 8; tries++) {
+    int cell = s->rooms[randomBelow(&s->rng, s->count)];
+    int x = cell % s->w, y = cell / s->w;
+    int dir = randomBelow(&s->rng, 4);
+    int nx = x + (dir == 0) - (dir == 1);
+    int ny = y + (dir == 2) - (dir == 3);
+    if (nx < 0 || ny < 0 || nx >= s->w || ny >= s->h) {
+      continue;
+    }
+    int next = ny * s->w + nx;
+    if (!(s->flags[next] & CELL_ROOM)) {
+      addRoom(s, next, false);
+      linkCells(s, cell, next);
+    }
+  }
+
+  for (int i = 0; i < s->count; i++) {
+    int cell = s->rooms[i];
+    int x = cell % s->w, y = cell / s->w;
+    if (x + 1 < s->w && (s->flags[cell + 1] & CELL_ROOM) &&
+        !(s->flags[cell] & DOOR_RIGHT) && randomBelow(&s->rng, 12) == 0) {
+      linkCells(s, cell, cell + 1);
+    }
+    if (y + 1 < s->h && (s->flags[cell + s->w] & CELL_ROOM) &&
+        !(s->flags[cell] & DOOR_DOWN) && randomBelow(&s->rng, 12) == 0) {
+      linkCells(s, cell, cell + s->w);
+    }
+  }
+}
+
+/*
+ * pillars on tiles with odd coordinates, off the middle row and column,
+ * never cut off a door or the middle of the room where the player starts
+ */
+void placePillars(Sector *s, unsigned char *tiles) {
+  for (int y = 1; y < TILES_Y; y += 2) {
+    for (int x = 1; x < TILES_X; x += 2) {
+      if (x != TILES_X / 2 && y != TILES_Y / 2 &&
+          randomBelow(&s->rng, 3) == 0) {
+        int i = y * TILES_X + x;
+        tiles[i / 8] |= 1 << (i % 8);
+      }
+    }
+  }
+}
+
+// generate the rooms of one sector, without writing them out yet
+void generateSector(void *ctx, int i) {
+  DungeonJob *job = ctx;
+  const DungeonParams *p = job->params;
+  int sx = i % sectorsX(p);
+  int sy = i / sectorsX(p);
+  Sector *s = &job->sectors[i];
+  *s = (Sector){.x0 = sx * DUNGEON_SECTOR,
+                .y0 = sy * DUNGEON_SECTOR,
+                .w = sectorWidth(p, sx),
+                .h = sectorHeight(p, sy),
+                .rng = sectorHash(p->seed, sx, sy, SALT_ROOMS)};
+
+  int hub = sectorHub(p, sx, sy);
+  addRoom(s, hub, false);
+  if (linkedUp(p, sx, sy)) {
+    int x = sectorHash(p->seed, sx, sy, SALT_GATE_UP) % s->w;
+    addGate(s, hub, x, 0, DOOR_UP);
+  }
+  if (linkedLeft(p, sx, sy)) {
+    int y = sectorHash(p->seed, sx, sy, SALT_GATE_LEFT) % s->h;
+    addGate(s, hub, 0, y, DOOR_LEFT);
+  }
+  // the neighbours pick where their links cross, with their own hashes
+  if (sy + 1 < sectorsY(p) && linkedUp(p, sx, sy + 1)) {
+    int x = sectorHash(p->seed, sx, sy + 1, SALT_GATE_UP) % s->w;
+    addGate(s, hub, x, s->h - 1, DOOR_DOWN);
+  }
+  if (sx + 1 < sectorsX(p) && linkedLeft(p, sx + 1, sy)) {
+    int y = sectorHash(p->seed, sx + 1, sy, SALT_GATE_LEFT) % s->h;
+    addGate(s, hub, s->w - 1, y, DOOR_RIGHT);
+  }
+  growRooms(s);
+}
+
+// write the rooms of one sector to the pack, from its first one on
+void writeSector(void *ctx, int i) {
+  DungeonJob *job = ctx;
+  Sector *s = &job->sectors[i];
+  PackRoom *room = packRooms(job->pack) + s->first;
+  for (int cell = 0; cell < s->w * s->h; cell++) {
+    if (s->flags[cell] & CELL_ROOM) {
+      room->x = s->x0 + cell % s->w;
+      room->y = s->y0 + cell / s->w;
+      room->doors = s->flags[cell] & ~CELL_ROOM;
+      if (!s->corridor[cell]) {
+        placePillars(s, room->tiles);
+      }
+      room++;
+    }
+  }
+}
+
+void linkSector(void *ctx, int i) {
+  DungeonJob *job = ctx;
+  Sector *s = &job->sectors[i];
+  linkRoomPack(job->pack, s->first, s->first + s->count);
+}
+
+void dungeonError(const char *spec, const char *msg) {
+  fprintf(stderr, "Bad dungeon %s: %s\n", spec, msg);
+  exit(1);
+}
+
+bool parseDungeonSpec(const char *spec, DungeonParams *params) {
+  if (strncmp(spec, "seed:", 5) != 0) {
+    return false;
+  }
+  char *end;
+  params->seed = strtoull(spec + 5, &end, 10);
+  params->width = DUNGEON_DEFAULT_SIZE;
+  params->height = DUNGEON_DEFAULT_SIZE;
+  if (end == spec + 5) {
+    dungeonError(spec, "expected seed:<n>[:<width>x<height>]");
+  }
+  if (*end == ':') {
+    char *x;
+    long width = strtol(end + 1, &x, 10);
+    long height = *x == 'x' ? strtol(x + 1, &end, 10) : 0;
+    if (width < 1 || height < 1 || *end != '\0') {
+      dungeonError(spec, "expected seed:<n>[:<width>x<height>]");
+    }
+    if (width > INT_MAX / height) {
+      dungeonError(spec, "too many rooms");
+    }
+    params->width = width;
+    params->height = height;
+  } else if (*end != '\0') {
+    dungeonError(spec, "expected seed:<n>[:<width>x<height>]");
+  }
+  return true;
+}
+
+/*
+ * the map is cut into sectors that are generated independently, in
+ * parallel, each from its own hashes of the seed
+ * every sector grows its rooms from a hub cell, with a corridor to each
+ * link to a neighbouring sector, so there is nothing to share between jobs
+ * once the number of rooms of every sector is known, each sector writes
+ * its rooms to its own part of the pack, and links them after the pack is
+ * indexed
+ */
+RoomPack generateDungeon(DungeonParams params, JobSystem *jobs) {
+  int sectors = sectorsX(&params) * sectorsY(&params);
+  DungeonJob job = {&params, malloc(sectors * sizeof *job.sectors), NULL};
+  runJobs(jobs, generateSector, &job, sectors);
+
+  int rooms = 0;
+  for (int i = 0; i < sectors; i++) {
+    job.sectors[i].first = rooms;
+    rooms += job.sectors[i].count;
+  }
+  RoomPack pack = allocRoomPack(params.width, params.height, rooms);
+  job.pack = &pack;
+  runJobs(jobs, writeSector, &job, sectors);
+  indexRoomPack(&pack);
+  runJobs(jobs, linkSector, &job, sectors);
+  free(job.sectors);
+
+  // start in the hub of the middle sector
+  int sx = sectorsX(&params) / 2;
+  int sy = sectorsY(&params) / 2;
+  int hub = sectorHub(&params, sx, sy);
+  int w = sectorWidth(&params, sx);
+  pack.header.start = packFindRoom(&pack, sx * DUNGEON_SECTOR + hub % w,
+                                   sy * DUNGEON_SECTOR + hub / w);
+  return pack;
+}
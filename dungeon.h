@@ -0,0 +1,34 @@
+#ifndef DUNGEON_H
+#define DUNGEON_H
+
+#include "jobs.h"
+#include "roompack.h"
+#include <stdint.h>
+
+// maps are generated in square sectors of this many rooms a side, one job
+// per sector
+#define DUNGEON_SECTOR 16
+// size in rooms of a map given only a seed
+#define DUNGEON_DEFAULT_SIZE 64
+
+typedef struct DungeonParams {
+  uint64_t seed;
+  int width; // map size in rooms
+  int height;
+} DungeonParams;
+
+/*
+ * a map path of the form seed:<n> or seed:<n>:<width>x<height> asks for a
+ * generated map instead of a pack file
+ * returns false for anything else, and exits on a malformed spec
+ */
+bool parseDungeonSpec(const char *spec, DungeonParams *params);
+
+/*
+ * generate a map of connected rooms from params.seed, the same seed and
+ * size always give the same map, whatever the number of threads
+ * the result is a room pack held in memory, unloaded with unloadRoomPack
+ */
+RoomPack generateDungeon(DungeonParams params, JobSystem *jobs);
+
+#endif
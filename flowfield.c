@@ -0,0 +1,111 @@
+#include "flowfield.h"
+#include <string.h>
+
+// the 8 neighbours, straight ones first
+const int neighbourX[8] = {0, 0, -1, 1, -1, 1, -1, 1};
+const int neighbourY[8] = {-1, 1, 0, 0, -1, -1, 1, 1};
+
+// tile under pos, positions over the walls count as the nearest tile
+int tileAt(Vector2 pos) {
+  int x = (pos.x - WALL_THICKNESS) / BLOCK_SIZE;
+  int y = (pos.y - WALL_THICKNESS) / BLOCK_SIZE;
+  x = x < 0 ? 0 : x >= TILES_X ? TILES_X - 1 : x;
+  y = y < 0 ? 0 : y >= TILES_Y ? TILES_Y - 1 : y;
+  return y * TILES_X + x;
+}
+
+bool tileFree(const Block *blocks, int x, int y) {
+  return x >= 0 && x < TILES_X && y >= 0 && y < TILES_Y &&
+         !blocks[8 + y * TILES_X + x].enabled;
+}
+
+// a diagonal step may not cut the corner of a block
+bool canStep(const Block *blocks, int x, int y, int dir) {
+  int dx = neighbourX[dir];
+  int dy = neighbourY[dir];
+  if (!tileFree(blocks, x + dx, y + dy)) {
+    return false;
+  }
+  return dx == 0 || dy == 0 ||
+         (tileFree(blocks, x + dx, y) && tileFree(blocks, x, y + dy));
+}
+
+void buildFlowField(FlowField *field, const Block *blocks, int target) {
+  memset(field->dist, FLOW_UNREACHABLE, sizeof field->dist);
+  int queue[FLOW_TILES];
+  int head = 0;
+  int tail = 0;
+  // the search starts at the target even if it is not free, the player
+  // can stand over a block tile's edge at a door
+  field->dist[target] = 0;
+  queue[tail++] = target;
+  while (head < tail) {
+    int tile = queue[head++];
+    int x = tile % TILES_X;
+    int y = tile / TILES_X;
+    for (int dir = 0; dir < 8; dir++) {
+      if (!canStep(blocks, x, y, dir)) {
+        continue;
+      }
+      int n = tile + neighbourY[dir] * TILES_X + neighbourX[dir];
+      if (field->dist[n] == FLOW_UNREACHABLE) {
+        field->dist[n] = field->dist[tile] + 1;
+        queue[tail++] = n;
+      }
+    }
+  }
+
+  // of the neighbours one step closer, go to the one nearest the target,
+  // so paths through open space come out straight
+  int targetX = target % TILES_X;
+  int targetY = target / TILES_X;
+  for (int tile = 0; tile < FLOW_TILES; tile++) {
+    field->next[tile] = -1;
+    if (field->dist[tile] == 0 || field->dist[tile] == FLOW_UNREACHABLE) {
+      continue;
+    }
+    int x = tile % TILES_X;
+    int y = tile / TILES_X;
+    int best = -1;
+    for (int dir = 0; dir < 8; dir++) {
+      int n = tile + neighbourY[dir] * TILES_X + neighbourX[dir];
+      if (!canStep(blocks, x, y, dir) ||
+          field->dist[n] != field->dist[tile] - 1) {
+        continue;
+      }
+      int dx = x + neighbourX[dir] - targetX;
+      int dy = y + neighbourY[dir] - targetY;
+      int d = dx * dx + dy * dy;
+      if (best == -1 || d < best) {
+        best = d;
+        field->next[tile] = n;
+      }
+    }
+  }
+  field->target = target;
+}
+
+// rebuild the field if the player moved to another tile or room
+void updateFlowField(FlowField *field, const Block *blocks, int roomIdx,
+                     Vector2 playerPos) {
+  int target = tileAt(playerPos);
+  if (field->roomIdx != roomIdx || field->target != target) {
+    field->roomIdx = roomIdx;
+    buildFlowField(field, blocks, target);
+  }
+}
+
+/*
+ * where something at pos should head for to reach the player: the center
+ * of the next tile on its path, or the player itself once it is in the
+ * player's tile or a neighbour of it, or has no path
+ */
+Vector2 flowTarget(const FlowField *field, Vector2 pos, Vector2 playerPos) {
+  int tile = tileAt(pos);
+  if (field->dist[tile] <= 1 || field->dist[tile] == FLOW_UNREACHABLE) {
+    return playerPos;
+  }
+  int next = field->next[tile];
+  return (Vector2){WALL_THICKNESS + (next % TILES_X + 0.5f) * BLOCK_SIZE,
+                   WALL_THICKNESS + (next / TILES_X + 0.5f) * BLOCK_SIZE};
+}
@@ -0,0 +1,29 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include "game.h"
+
+#define FLOW_TILES (TILES_X * TILES_Y)
+#define FLOW_UNREACHABLE 0xff
+
+/*
+ * paths from every tile of a room to the tile the player is in, found by a
+ * breadth first search over the free tiles, moving like the enemies do in
+ * 8 directions
+ * only rebuilt when the player gets to another tile or room, after which
+ * any number of enemies look their way up in constant time
+ */
+typedef struct FlowField {
+  int roomIdx; // room and tile the field leads to, -1 before the first build
+  int target;
+  unsigned char dist[FLOW_TILES]; // steps to the target tile
+  int next[FLOW_TILES];           // tile to go to next, -1 at the target
+} FlowField;
+
+int tileAt(Vector2 pos);
+void buildFlowField(FlowField *field, const Block *blocks, int target);
+void updateFlowField(FlowField *field, const Block *blocks, int roomIdx,
+                     Vector2 playerPos);
+Vector2 flowTarget(const FlowField *field, Vector2 pos, Vector2 playerPos);
+
+#endif
@@ -0,0 +1,888 @@
+#include "game.h"
+#include "collision.h"
+#include "dungeon.h"
+#include "flowfield.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "roompack.h"
+#include "roomstore.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * collect the indices of the blocks a circle of radius rad can touch while
+ * its center stays inside the box from lo to hi
+ * interior blocks sit on the tile grid, so only the tiles under the box are
+ * looked at, the 8 wall segments only when the box reaches the border
+ * indices come out in the same order as in blocks, returns how many
+ */
+int nearbyBlocks(Block *blocks, Vector2 lo, Vector2 hi, int rad, int *out) {
+  int n = 0;
+  // one pixel of slack, the exact test is done by the caller
+  float minX = lo.x - rad - 1;
+  float minY = lo.y - rad - 1;
+  float maxX = hi.x + rad + 1;
+  float maxY = hi.y + rad + 1;
+
+  if (minX < WALL_THICKNESS || minY < WALL_THICKNESS ||
+      maxX > SCREEN_WIDTH - WALL_THICKNESS ||
+      maxY > SCREEN_HEIGHT - WALL_THICKNESS) {
+    for (int i = 0; i < 8; i++) {
+      out[n++] = i;
+    }
+  }
+
+  int startX = floorf((minX - WALL_THICKNESS) / BLOCK_SIZE);
+  int startY = floorf((minY - WALL_THICKNESS) / BLOCK_SIZE);
+  int endX = floorf((maxX - WALL_THICKNESS) / BLOCK_SIZE);
+  int endY = floorf((maxY - WALL_THICKNESS) / BLOCK_SIZE);
+  startX = startX < 0 ? 0 : startX;
+  startY = startY < 0 ? 0 : startY;
+  endX = endX > TILES_X - 1 ? TILES_X - 1 : endX;
+  endY = endY > TILES_Y - 1 ? TILES_Y - 1 : endY;
+
+  for (int y = startY; y <= endY; y++) {
+    for (int x = startX; x <= endX; x++) {
+      int i = 8 + y * TILES_X + x;
+      if (blocks[i].enabled) {
+        out[n++] = i;
+      }
+    }
+  }
+  return n;
+}
+
+void initProjectiles(ProjectilesContainer *pc, int capacity) {
+  *pc = (ProjectilesContainer){0};
+  pc->capacity = capacity;
+  pc->x = malloc(capacity * sizeof *pc->x);
+  pc->y = malloc(capacity * sizeof *pc->y);
+  pc->prevX = malloc(capacity * sizeof *pc->prevX);
+  pc->prevY = malloc(capacity * sizeof *pc->prevY);
+  pc->speedX = malloc(capacity * sizeof *pc->speedX);
+  pc->speedY = malloc(capacity * sizeof *pc->speedY);
+  pc->radius = malloc(capacity * sizeof *pc->radius);
+  pc->lifeTime = malloc(capacity * sizeof *pc->lifeTime);
+  pc->hit = malloc(capacity * sizeof *pc->hit);
+}
+
+void freeProjectiles(ProjectilesContainer *pc) {
+  free(pc->x);
+  free(pc->y);
+  free(pc->prevX);
+  free(pc->prevY);
+  free(pc->speedX);
+  free(pc->speedY);
+  free(pc->radius);
+  free(pc->lifeTime);
+  free(pc->hit);
+  *pc = (ProjectilesContainer){0};
+}
+
+// double the capacity of every array
+void growProjectiles(ProjectilesContainer *pc) {
+  int capacity = pc->capacity > 0 ? pc->capacity * 2 : PROJECTILE_CAPACITY;
+  float *x = realloc(pc->x, capacity * sizeof *x);
+  float *y = realloc(pc->y, capacity * sizeof *y);
+  float *prevX = realloc(pc->prevX, capacity * sizeof *prevX);
+  float *prevY = realloc(pc->prevY, capacity * sizeof *prevY);
+  float *speedX = realloc(pc->speedX, capacity * sizeof *speedX);
+  float *speedY = realloc(pc->speedY, capacity * sizeof *speedY);
+  int *radius = realloc(pc->radius, capacity * sizeof *radius);
+  int *lifeTime = realloc(pc->lifeTime, capacity * sizeof *lifeTime);
+  unsigned char *hit = realloc(pc->hit, capacity * sizeof *hit);
+  if (!x || !y || !prevX || !prevY || !speedX || !speedY || !radius ||
+      !lifeTime || !hit) {
+    perror("Failed growing projectiles");
+    exit(1);
+  }
+  pc->x = x;
+  pc->y = y;
+  pc->prevX = prevX;
+  pc->prevY = prevY;
+  pc->speedX = speedX;
+  pc->speedY = speedY;
+  pc->radius = radius;
+  pc->lifeTime = lifeTime;
+  pc->hit = hit;
+  pc->capacity = capacity;
+}
+
+// remove projectile i by moving the last live one into its place
+void despawnProjectile(ProjectilesContainer *pc, int i) {
+  int last = --pc->count;
+  pc->x[i] = pc->x[last];
+  pc->y[i] = pc->y[last];
+  pc->prevX[i] = pc->prevX[last];
+  pc->prevY[i] = pc->prevY[last];
+  pc->speedX[i] = pc->speedX[last];
+  pc->speedY[i] = pc->speedY[last];
+  pc->radius[i] = pc->radius[last];
+  pc->lifeTime[i] = pc->lifeTime[last];
+  pc->hit[i] = pc->hit[last];
+}
+
+void shoot(float xSpeed, float ySpeed, Vector2 origin,
+           ProjectilesContainer *pc) {
+  /*
+     Register a new projectile
+     */
+  if (pc->count == pc->capacity) {
+    growProjectiles(pc);
+  }
+  int i = pc->count++;
+  pc->x[i] = origin.x;
+  pc->y[i] = origin.y;
+  pc->prevX[i] = origin.x;
+  pc->prevY[i] = origin.y;
+  pc->speedX[i] = xSpeed;
+  pc->speedY[i] = ySpeed;
+  pc->radius[i] = 5;
+  pc->lifeTime[i] = 60;
+}
+
+void playerShoot(Character *player, ProjectilesContainer *pc, Input input) {
+  if (player->shotCharge >= player->firerate) {
+    float speed = player->shotSpeed;
+    if (input & INPUT_SHOOT_RIGHT) {
+      shoot(speed, 0.0f, player->position, pc);
+      player->shotCharge = 0;
+    } else if (input & INPUT_SHOOT_LEFT) {
+      shoot(-speed, 0.0f, player->position, pc);
+      player->shotCharge = 0;
+    } else if (input & INPUT_SHOOT_DOWN) {
+      shoot(0.0f, speed, player->position, pc);
+      player->shotCharge = 0;
+    } else if (input & INPUT_SHOOT_UP) {
+      shoot(0.0f, -speed, player->position, pc);
+      player->shotCharge = 0;
+    }
+  }
+}
+
+/*
+ * the fraction of bubble i's next move at which it first hits a block or
+ * an enemy, or -1 if it does not
+ */
+float sweepProjectile(const ProjectilesContainer *pc, int i, Block blocks[],
+                      const EnemiesContainer *enemies) {
+  Vector2 pos = {pc->x[i], pc->y[i]};
+  Vector2 move = {pc->speedX[i], pc->speedY[i]};
+  Vector2 end = {pos.x + move.x, pos.y + move.y};
+  int rad = pc->radius[i];
+  float first = -1;
+
+  Vector2 lo = {fminf(pos.x, end.x), fminf(pos.y, end.y)};
+  Vector2 hi = {fmaxf(pos.x, end.x), fmaxf(pos.y, end.y)};
+  int nearby[MAX_BLOCKS];
+  int n = nearbyBlocks(blocks, lo, hi, rad, nearby);
+  for (int j = 0; j < n; j++) {
+    float t = sweptBlockCollision(blocks[nearby[j]], pos, move, rad);
+    if (t >= 0 && (first < 0 || t < first)) {
+      first = t;
+    }
+  }
+  for (int j = 0; j < enemies->count; j++) {
+    Vector2 enemy = {enemies->x[j], enemies->y[j]};
+    float t = sweptCircleCollision(pos, move, enemy, rad, enemies->radius[j]);
+    if (t >= 0 && (first < 0 || t < first)) {
+      first = t;
+    }
+  }
+  return first;
+}
+
+void updateProjectiles(ProjectilesContainer *pc, Block blocks[],
+                       const EnemiesContainer *enemies) {
+  // despawn if lifetime ran out
+  for (int i = 0; i < pc->count; i++) {
+    pc->hit[i] = pc->lifeTime[i] == 0;
+  }
+
+  // check for collision with blocks, all bubbles in one batch
+  blockCollisionBatch(pc->x, pc->y, pc->radius, pc->count, blocks, MAX_BLOCKS,
+                      pc->hit);
+
+  // check for enemy collision, the enemy arrays only hold live ones
+  // TODO damage enenmy
+  // TODO also check for collision with player, if enemy shoots
+  if (enemies->count < BROADPHASE_MIN_ENEMIES) {
+    circleCollisionBatch(pc->x, pc->y, pc->radius, pc->count, enemies->x,
+                         enemies->y, enemies->radius, enemies->count, pc->hit);
+  } else {
+    // only test the enemies in the cells around each bubble
+    EnemyGrid grid;
+    buildEnemyGrid(&grid, enemies->x, enemies->y, enemies->radius,
+                   enemies->count);
+    circleCollisionGrid(pc->x, pc->y, pc->radius, pc->count, &grid, pc->hit);
+  }
+
+  // fast bubbles could pass through something between two steps, so
+  // sweep their next move too
+  for (int i = 0; i < pc->count; i++) {
+    if (pc->hit[i] || fabsf(pc->speedX[i]) + fabsf(pc->speedY[i]) <
+                          SWEEP_MIN_MOVE + 2 * pc->radius[i]) {
+      continue;
+    }
+    float t = sweepProjectile(pc, i, blocks, enemies);
+    if (t >= 0) {
+      // stop where it hits, and despawn it in the next step
+      pc->speedX[i] *= t;
+      pc->speedY[i] *= t;
+      pc->lifeTime[i] = 1;
+    }
+  }
+
+  int i = 0;
+  while (i < pc->count) {
+    if (pc->hit[i]) {
+      // the last projectile is moved here, so look at index i again
+      despawnProjectile(pc, i);
+      continue;
+    }
+    pc->prevX[i] = pc->x[i];
+    pc->prevY[i] = pc->y[i];
+    pc->x[i] += pc->speedX[i];
+    pc->y[i] += pc->speedY[i];
+    pc->lifeTime[i] -= 1;
+    i++;
+  }
+}
+
+void resetProjectiles(ProjectilesContainer *pc) { pc->count = 0; }
+
+// copy the live projectiles of src into dst, which keeps its own arrays
+void copyProjectiles(ProjectilesContainer *dst,
+                     const ProjectilesContainer *src) {
+  if (dst->capacity < src->count) {
+    freeProjectiles(dst);
+    initProjectiles(dst, src->capacity);
+  }
+  int n = src->count;
+  dst->count = n;
+  if (n == 0) {
+    // dst may not have any arrays yet
+    return;
+  }
+  memcpy(dst->x, src->x, n * sizeof *dst->x);
+  memcpy(dst->y, src->y, n * sizeof *dst->y);
+  memcpy(dst->prevX, src->prevX, n * sizeof *dst->prevX);
+  memcpy(dst->prevY, src->prevY, n * sizeof *dst->prevY);
+  memcpy(dst->speedX, src->speedX, n * sizeof *dst->speedX);
+  memcpy(dst->speedY, src->speedY, n * sizeof *dst->speedY);
+  memcpy(dst->radius, src->radius, n * sizeof *dst->radius);
+  memcpy(dst->lifeTime, src->lifeTime, n * sizeof *dst->lifeTime);
+}
+
+void updatePos(Character *player, Block *blocks, Vector2 newPos) {
+  bool xAllowed = 1;
+  bool yAllowed = 1;
+  int forceX = 0;
+  int forceY = 0;
+  int rad = player->radius;
+
+  // only blocks near the current or the new position can have an effect
+  Vector2 lo = {fminf(player->position.x, newPos.x),
+                fminf(player->position.y, newPos.y)};
+  Vector2 hi = {fmaxf(player->position.x, newPos.x),
+                fmaxf(player->position.y, newPos.y)};
+  int nearby[MAX_BLOCKS];
+  int n = nearbyBlocks(blocks, lo, hi, rad, nearby);
+
+  for (int i = 0; i < n; i++) {
+    Block b = blocks[nearby[i]];
+    float bStartX = b.start.x;
+    float bStartY = b.start.y;
+    float bEndX = b.start.x + b.size.x;
+    float bEndY = b.start.y + b.size.y;
+    Vector2 newPosCollision = blockCollision(b, newPos, rad);
+
+    // colliding from left or right
+    // if player center is not within Y-interval, allow sliding around corner
+    bool playerOverBottomOfBlock = player->position.y < bEndY + rad;
+    bool playerUnderTopOfBlock = player->position.y > bStartY - rad;
+    if (playerOverBottomOfBlock && playerUnderTopOfBlock && newPosCollision.x) {
+      bool playerCenterBelowBlock = newPos.y > bEndY;
+      bool playerCenterAboveBlock = newPos.y < bStartY;
+      if (playerCenterBelowBlock) {
+        // force down
+        forceY = 1;
+      } else if (playerCenterAboveBlock) {
+        // force up
+        forceY = -1;
+      } else {
+        xAllowed = 0;
+      }
+    }
+
+    // colliding from top or bottom
+    // if player center is not within X-interval, allow sliding around corner
+    bool playerLeftOfRightBlockSide = player->position.x < bEndX + rad;
+    bool playerRightOfLeftBlockSide = player->position.x > bStartX - rad;
+    if (playerLeftOfRightBlockSide && playerRightOfLeftBlockSide &&
+        newPosCollision.y) {
+      bool playerCenterRightOfBlock = newPos.x > bEndX;
+      bool playerCenterLeftOfBlock = newPos.x < bStartX;
+      if (playerCenterRightOfBlock) {
+        // force right
+        forceX = 1;
+      } else if (playerCenterLeftOfBlock) {
+        // force left
+        forceX = -1;
+      } else {
+        yAllowed = 0;
+      }
+    }
+  }
+
+  float yChange = 0;
+  float xChange = 0;
+  // allow moving on X-axis
+  if (xAllowed) {
+    // check if sliding allowed
+    bool movingLeftOrRightAndShouldSlide =
+        ((player->position.x > newPos.x || player->position.x < newPos.x) &&
+         forceY != 0);
+    bool movingDownLeftOrRightAndShouldSlide =
+        (player->position.y < newPos.y &&
+         (player->position.x < newPos.x || player->position.x > newPos.x) &&
+         forceY == 1);
+    bool movingUpLeftOrRightAndShouldSlide =
+        (player->position.y > newPos.y &&
+         (player->position.x > newPos.x || player->position.x < newPos.x) &&
+         forceY == -1);
+    if (movingLeftOrRightAndShouldSlide ||
+        movingDownLeftOrRightAndShouldSlide ||
+        movingUpLeftOrRightAndShouldSlide) {
+      yChange = player->position.y + forceY * player->speed;
+      xChange = newPos.x;
+    } else { // moving left or right, unhindered
+      player->position.x = newPos.x;
+    }
+  }
+  // allow moving on Y-axis
+  if (yAllowed) {
+    // check if sliding allowed
+    bool movingUpOrDownAndShouldSlide =
+        ((player->position.y > newPos.y || player->position.y < newPos.y) &&
+         forceX != 0);
+    bool movingRightUpOrDownAndShouldSlide =
+        (player->position.x < newPos.x &&
+         (player->position.y > newPos.y || player->position.y < newPos.y) &&
+         forceX == 1);
+    bool movingLeftUpOrDownAndShouldSlide =
+        (player->position.x > newPos.x &&
+         (player->position.y > newPos.y || player->position.y < newPos.y) &&
+         forceX == -1);
+    if (movingUpOrDownAndShouldSlide || movingRightUpOrDownAndShouldSlide ||
+        movingLeftUpOrDownAndShouldSlide) {
+      xChange = player->position.x + forceX * player->speed;
+    } else { // moving up or down, unhindered
+      player->position.y = newPos.y;
+    }
+  }
+
+  if (xChange != 0) {
+    player->position.x = xChange;
+  }
+  if (yChange != 0) {
+    player->position.y = yChange;
+  }
+}
+
+/*
+ * move the player within the room
+ * returns the side (SIDE_*) of the door the player went out through, or -1
+ */
+int playerMove(Character *player, Room room, Input input) {
+  Vector2 newPos = player->position;
+  if (input & INPUT_MOVE_RIGHT) {
+    newPos.x += player->speed;
+  }
+  if (input & INPUT_MOVE_LEFT) {
+    newPos.x -= player->speed;
+  }
+  if (input & INPUT_MOVE_DOWN) {
+    newPos.y += player->speed;
+  }
+  if (input & INPUT_MOVE_UP) {
+    newPos.y -= player->speed;
+  }
+
+  updatePos(player, room.blocks, newPos);
+
+  if (player->position.x < 0) {
+    return SIDE_LEFT;
+  } else if (player->position.x > SCREEN_WIDTH) {
+    return SIDE_RIGHT;
+  } else if (player->position.y < 0) {
+    return SIDE_UP;
+  } else if (player->position.y > SCREEN_HEIGHT) {
+    return SIDE_DOWN;
+  } else {
+    return -1;
+  }
+}
+
+// add a live enemy, returns its index or -1 when there is no room for it
+int spawnEnemy(EnemiesContainer *ec, Vector2 pos, float speed, int radius) {
+  if (ec->count == MAX_ENEMIES) {
+    return -1;
+  }
+  int i = ec->count++;
+  ec->x[i] = pos.x;
+  ec->y[i] = pos.y;
+  ec->prevX[i] = pos.x;
+  ec->prevY[i] = pos.y;
+  ec->speed[i] = speed;
+  ec->radius[i] = radius;
+  return i;
+}
+
+// the last enemy is moved into the hole, like with the projectiles
+void despawnEnemy(EnemiesContainer *ec, int i) {
+  int last = --ec->count;
+  ec->x[i] = ec->x[last];
+  ec->y[i] = ec->y[last];
+  ec->prevX[i] = ec->prevX[last];
+  ec->prevY[i] = ec->prevY[last];
+  ec->speed[i] = ec->speed[last];
+  ec->radius[i] = ec->radius[last];
+}
+
+// copy the live enemies of src into dst
+void copyEnemies(EnemiesContainer *dst, const EnemiesContainer *src) {
+  int n = src->count;
+  memcpy(dst->x, src->x, n * sizeof *dst->x);
+  memcpy(dst->y, src->y, n * sizeof *dst->y);
+  memcpy(dst->prevX, src->prevX, n * sizeof *dst->prevX);
+  memcpy(dst->prevY, src->prevY, n * sizeof *dst->prevY);
+  memcpy(dst->speed, src->speed, n * sizeof *dst->speed);
+  memcpy(dst->radius, src->radius, n * sizeof *dst->radius);
+  dst->count = n;
+}
+
+/*
+ * move every live enemy a step towards the player, around blocks along the
+ * flow field
+ */
+void moveEnemies(EnemiesContainer *ec, Character player, Block *blocks,
+                 const FlowField *flow) {
+  for (int i = 0; i < ec->count; i++) {
+    float x = ec->x[i];
+    float y = ec->y[i];
+    float speed = ec->speed[i];
+    int radius = ec->radius[i];
+
+    Vector2 goal = flowTarget(flow, (Vector2){x, y}, player.position);
+    float xDiff = goal.x - x;
+    float yDiff = goal.y - y;
+    int xSign = (xDiff > 0) - (xDiff < 0);
+    int ySign = (yDiff > 0) - (yDiff < 0);
+
+    Vector2 newPos = {(int)x + xSign * speed, (int)y + ySign * speed};
+    // dont move if colliding with player
+    // subtract 8 from radius, to let them "touch more" ;-)
+    if (!circleCollision(newPos, player.position, radius - 8,
+                         player.radius)) {
+      // updatePos moves a Character, so move a copy and write it back
+      Character enemy = {{x, y}, speed, radius, 0, 0, 0, true};
+      updatePos(&enemy, blocks, newPos);
+      ec->x[i] = enemy.position.x;
+      ec->y[i] = enemy.position.y;
+    }
+  }
+}
+
+// put the 8 blocks of the outer walls in blocks, with gaps for the doors
+void makeWall(bool *adjacentDoors, Block *blocks) {
+  blocks[0] = (Block){
+      (Vector2){0, 0},
+      (Vector2){(SCREEN_WIDTH / 2) - ((DOORSIZE / 2) * adjacentDoors[0]),
+                WALL_THICKNESS},
+      true};
+  blocks[1] = (Block){
+      (Vector2){(SCREEN_WIDTH / 2) + ((DOORSIZE / 2) * adjacentDoors[0]), 0},
+      (Vector2){(SCREEN_WIDTH / 2) - ((DOORSIZE / 2) * adjacentDoors[0]),
+                WALL_THICKNESS},
+      true};
+  // Left border
+  blocks[2] = (Block){
+      (Vector2){0, 0},
+      (Vector2){WALL_THICKNESS,
+                (SCREEN_HEIGHT / 2) - ((DOORSIZE / 2) * adjacentDoors[1])},
+      true};
+  blocks[3] = (Block){
+      (Vector2){0, (SCREEN_HEIGHT / 2) + ((DOORSIZE / 2) * adjacentDoors[1])},
+      (Vector2){WALL_THICKNESS,
+                (SCREEN_HEIGHT / 2) - ((DOORSIZE / 2) * adjacentDoors[1])},
+      true};
+  // Bottom border
+  blocks[4] = (Block){
+      (Vector2){0, SCREEN_HEIGHT - WALL_THICKNESS},
+      (Vector2){(SCREEN_WIDTH / 2) - ((DOORSIZE / 2) * adjacentDoors[2]),
+                WALL_THICKNESS},
+      true};
+  blocks[5] = (Block){
+      (Vector2){(SCREEN_WIDTH / 2) + ((DOORSIZE / 2) * adjacentDoors[2]),
+                SCREEN_HEIGHT - WALL_THICKNESS},
+      (Vector2){(SCREEN_WIDTH / 2) - ((DOORSIZE / 2) * adjacentDoors[2]),
+                WALL_THICKNESS},
+      true};
+  // Right border
+  blocks[6] = (Block){
+      (Vector2){SCREEN_WIDTH - WALL_THICKNESS, 0},
+      (Vector2){WALL_THICKNESS,
+                (SCREEN_HEIGHT / 2) - ((DOORSIZE / 2) * adjacentDoors[3])},
+      true};
+  blocks[7] = (Block){
+      (Vector2){SCREEN_WIDTH - WALL_THICKNESS,
+                (SCREEN_HEIGHT / 2) + ((DOORSIZE / 2) * adjacentDoors[3])},
+      (Vector2){WALL_THICKNESS,
+                (SCREEN_HEIGHT / 2) - ((DOORSIZE / 2) * adjacentDoors[3])},
+      true};
+}
+
+Block makeBlock(int x, int y) {
+  int realX = WALL_THICKNESS + x * BLOCK_SIZE;
+  int realY = WALL_THICKNESS + y * BLOCK_SIZE;
+  Block b = {
+      (Vector2){realX, realY},
+      (Vector2){BLOCK_SIZE, BLOCK_SIZE},
+      true,
+  };
+  return b;
+}
+
+// read file with name "fname" and put it into buf
+void readRoom(char *fname, char *buf) {
+  const int tiles = TILES_X * TILES_Y;
+  FILE *file;
+  file = fopen(fname, "r");
+
+  if (file == NULL) {
+    perror("Failed reading file");
+    exit(1);
+  }
+
+  fgets(buf, tiles + 1, file);
+  fclose(file);
+}
+
+/*
+ * build a room into blocks, which has room for MAX_BLOCKS, from a layout of
+ * TILES_X * TILES_Y '0'/'1' characters, where '1' is a block
+ */
+Room makeRoomFromLayout(Block *blocks, bool up, bool down, bool left,
+                        bool right, const char *layout, Color color) {
+  bool adjacentDoors[4] = {up, left, down, right};
+  makeWall(adjacentDoors, blocks);
+  // zeroed, so the tiles left empty below are not garbage
+  memset(blocks + 8, 0, TILES_X * TILES_Y * sizeof *blocks);
+
+  for (int i = 8; i < TILES_X * TILES_Y + 8; i++) {
+    // read line
+    bool enabled = layout[i - 8] == *"1";
+    if (enabled) {
+      int x = (i - 8) % TILES_X;
+      int y = ((i - 8) / TILES_X);
+      // int y = (int)floor((i - 8) / TILES_X);
+      blocks[i] = makeBlock(x, y);
+    }
+  }
+  Room room = {blocks, 1, color, NULL};
+  return room;
+}
+
+/*
+ * the room at roomIdx, its blocks are built from the pack the first time
+ * it is asked for, or again after it was evicted
+ */
+Room *getRoom(Game *game, int roomIdx) {
+  Room *room = findRoom(game->rooms, roomIdx);
+  if (room == NULL) {
+    room = insertRoom(game->rooms, roomIdx);
+    RoomState *state = room->state;
+    *room = makeRoomFromPack(game->pack, roomIdx, RED, room->blocks);
+    room->state = state;
+    // every room starts out with an enemy, where the first room had it
+    Vector2 spawn = {(float)SCREEN_WIDTH / 1.5, (float)SCREEN_HEIGHT / 1.5};
+    spawnEnemy(&state->enemies, spawn, 1.0f, STARTING_PLAYER_RADIUS);
+    state->lastStep = game->step;
+  }
+  return room;
+}
+
+/*
+ * build the rooms behind the doors of roomIdx ahead of time, then roomIdx
+ * itself, so it is the most recently used
+ */
+Room *enterRoom(Game *game, int roomIdx) {
+  for (int side = 0; side < SIDES; side++) {
+    int neighbour = packNeighbour(game->pack, roomIdx, side);
+    if (neighbour >= 0) {
+      getRoom(game, neighbour);
+    }
+  }
+  return getRoom(game, roomIdx);
+}
+
+/*
+ * advance the bubbles of a room that was left steps ago in one go, instead
+ * of step by step: the ones whose lifetime ran out are gone, the others
+ * move the whole way and are only checked against the blocks and the room
+ * where they end up
+ * enemies only chase the player, so they wait where they were
+ */
+void catchUpProjectiles(ProjectilesContainer *pc, Block *blocks, long steps) {
+  int i = 0;
+  while (i < pc->count) {
+    if (pc->lifeTime[i] <= steps) {
+      despawnProjectile(pc, i);
+      continue;
+    }
+    pc->prevX[i] = pc->x[i] += pc->speedX[i] * steps;
+    pc->prevY[i] = pc->y[i] += pc->speedY[i] * steps;
+    pc->lifeTime[i] -= steps;
+    i++;
+  }
+  memset(pc->hit, 0, pc->count);
+  blockCollisionBatch(pc->x, pc->y, pc->radius, pc->count, blocks, MAX_BLOCKS,
+                      pc->hit);
+  i = 0;
+  while (i < pc->count) {
+    bool outside = pc->x[i] < 0 || pc->x[i] > SCREEN_WIDTH || pc->y[i] < 0 ||
+                   pc->y[i] > SCREEN_HEIGHT;
+    if (pc->hit[i] || outside) {
+      despawnProjectile(pc, i);
+      continue;
+    }
+    i++;
+  }
+}
+
+// hand what lives in the room the player is leaving back to the room
+void leaveRoomState(Game *game, RoomState *state) {
+  copyEnemies(&state->enemies, &game->enemies);
+  copyProjectiles(&state->pc, &game->pc);
+  state->lastStep = game->step;
+  setFlying(game->rooms, state - game->rooms->states, state->pc.count > 0);
+}
+
+// make the room the player enters the simulated one, caught up to now
+void takeRoomState(Game *game, RoomState *state, Block *blocks) {
+  copyEnemies(&game->enemies, &state->enemies);
+  copyProjectiles(&game->pc, &state->pc);
+  catchUpProjectiles(&game->pc, blocks, game->step - state->lastStep);
+  // simulated step by step from now on
+  setFlying(game->rooms, state - game->rooms->states, false);
+}
+
+void tickRoom(void *ctx, int i) {
+  Game *game = ctx;
+  Room *room = &game->rooms->rooms[game->rooms->flying[i]];
+  RoomState *state = room->state;
+  catchUpProjectiles(&state->pc, room->blocks, game->step - state->lastStep);
+  state->lastStep = game->step;
+}
+
+/*
+ * coarse tick of the built rooms the player is not in, that still have
+ * bubbles in flight
+ * rooms only touch their own state, so each is a job of its own and they
+ * run in parallel
+ */
+void tickRooms(Game *game) {
+  RoomStore *store = game->rooms;
+  runJobs(game->jobs, tickRoom, game, store->flyingCount);
+  // backwards, as taking a room out moves the last one into its place
+  for (int i = store->flyingCount - 1; i >= 0; i--) {
+    int slot = store->flying[i];
+    if (store->states[slot].pc.count == 0) {
+      setFlying(store, slot, false);
+    }
+  }
+}
+
+void gameInit(Game *game, const char *mapPath) {
+  // init map values
+  int playerRadius = STARTING_PLAYER_RADIUS;
+
+  // init player values
+  game->player =
+      (Character){{(float)SCREEN_WIDTH / 2, (float)SCREEN_HEIGHT / 2},
+                  2.0f,
+                  (playerRadius),
+                  8,
+                  8,
+                  5.0f,
+                  true};
+
+  game->enemies.count = 0;
+  game->step = 0;
+
+  // init projectile values
+  initProjectiles(&game->pc, PROJECTILE_CAPACITY);
+
+  // pick the collision kernels before the job threads can use them
+  getSimdLevel();
+  game->jobs = malloc(sizeof *game->jobs);
+  initJobs(game->jobs, jobThreads());
+
+  // map the rooms in, they are built when the player gets near them
+  game->pack = malloc(sizeof *game->pack);
+  DungeonParams dungeon;
+  if (parseDungeonSpec(mapPath, &dungeon)) {
+    *game->pack = generateDungeon(dungeon, game->jobs);
+  } else {
+    *game->pack = loadRoomPack(mapPath);
+  }
+  game->rooms = malloc(sizeof *game->rooms);
+  initRoomStore(game->rooms, roomBudgetCapacity());
+  game->curRoom = game->pack->header.start;
+  Room *room = enterRoom(game, game->curRoom);
+  takeRoomState(game, room->state, room->blocks);
+  game->flow = malloc(sizeof *game->flow);
+  game->flow->roomIdx = -1;
+  game->accumulator = 0;
+  savePositions(game);
+}
+
+// remember where the player and enemies are, to draw between two steps
+void savePositions(Game *game) {
+  game->prevPlayer = game->player.position;
+  EnemiesContainer *ec = &game->enemies;
+  memcpy(ec->prevX, ec->x, ec->count * sizeof *ec->x);
+  memcpy(ec->prevY, ec->y, ec->count * sizeof *ec->y);
+}
+
+/*
+ * advance the simulation by one step of SIM_DT seconds, using the given input
+ * does not touch the window, so it can run headless
+ */
+void gameStep(Game *game, Input input) {
+  Character *player = &game->player;
+  Room room = *getRoom(game, game->curRoom);
+  savePositions(game);
+
+  // Player movement
+  double start = profileBegin();
+  int side = playerMove(player, room, input);
+  int a = side < 0 ? -1 : packNeighbour(game->pack, game->curRoom, side);
+  if (a >= 0) {
+    if (side == SIDE_RIGHT) {
+      player->position.x = 1;
+    } else if (side == SIDE_LEFT) {
+      player->position.x = SCREEN_WIDTH - 1;
+    } else if (side == SIDE_DOWN) {
+      player->position.y = 1;
+    } else if (side == SIDE_UP) {
+      player->position.y = SCREEN_HEIGHT - 1;
+    }
+    // the room left keeps its enemies and bubbles, and is not simulated
+    // until the player comes back
+    leaveRoomState(game, room.state);
+    game->curRoom = a;
+    room = *enterRoom(game, game->curRoom);
+    takeRoomState(game, room.state, room.blocks);
+    // jump to the new room instead of sliding across the screen
+    savePositions(game);
+  }
+  profileEnd(PROFILE_PLAYER_MOVE, start);
+
+  start = profileBegin();
+  player->shotCharge++;
+  // Detect shooting, register new projectile
+  playerShoot(player, &game->pc, input);
+  profileEnd(PROFILE_PLAYER_SHOOT, start);
+
+  // Update each projectile
+  start = profileBegin();
+  updateProjectiles(&game->pc, room.blocks, &game->enemies);
+  profileEnd(PROFILE_PROJECTILES, start);
+
+  // enemy movement
+  start = profileBegin();
+  updateFlowField(game->flow, room.blocks, game->curRoom, player->position);
+  moveEnemies(&game->enemies, *player, room.blocks, game->flow);
+  profileEnd(PROFILE_ENEMIES, start);
+
+  game->step++;
+  if (game->step % ROOM_TICK_STEPS == 0) {
+    start = profileBegin();
+    tickRooms(game);
+    profileEnd(PROFILE_ROOMS, start);
+  }
+}
+
+/*
+ * run as many steps as fit in the time since the last call, polling input
+ * for each, and return how far the clock is into the next step (0 to 1)
+ * for drawing between the previous and current positions
+ * long pauses are cut to MAX_FRAME_TIME, so the game slows down instead of
+ * trying to catch up forever
+ */
+float gameAdvance(Game *game, double frameTime, InputSource source) {
+  if (frameTime > MAX_FRAME_TIME) {
+    frameTime = MAX_FRAME_TIME;
+  }
+  game->accumulator += frameTime;
+  while (game->accumulator >= SIM_DT) {
+    gameStep(game, source.poll(source.ctx));
+    game->accumulator -= SIM_DT;
+  }
+  return game->accumulator / SIM_DT;
+}
+
+// position between prev and cur, alpha from 0 (prev) to 1 (cur)
+Vector2 lerpPosition(Vector2 prev, Vector2 cur, float alpha) {
+  return (Vector2){prev.x + (cur.x - prev.x) * alpha,
+                   prev.y + (cur.y - prev.y) * alpha};
+}
+
+unsigned long long hashBytes(unsigned long long h, const void *data,
+                             size_t size) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ bytes[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+/*
+ * FNV-1a hash of the state that changes while playing, for checking that
+ * two runs, e.g. a replay before and after an optimization, end the same
+ */
+unsigned long long hashGame(const Game *game) {
+  unsigned long long h = 14695981039346656037ULL;
+  h = hashBytes(h, &game->curRoom, sizeof game->curRoom);
+  h = hashBytes(h, &game->player.position, sizeof game->player.position);
+  h = hashBytes(h, &game->player.shotCharge, sizeof game->player.shotCharge);
+  const EnemiesContainer *ec = &game->enemies;
+  h = hashBytes(h, &ec->count, sizeof ec->count);
+  h = hashBytes(h, ec->x, ec->count * sizeof *ec->x);
+  h = hashBytes(h, ec->y, ec->count * sizeof *ec->y);
+  const ProjectilesContainer *pc = &game->pc;
+  h = hashBytes(h, &pc->count, sizeof pc->count);
+  h = hashBytes(h, pc->x, pc->count * sizeof *pc->x);
+  h = hashBytes(h, pc->y, pc->count * sizeof *pc->y);
+  h = hashBytes(h, pc->lifeTime, pc->count * sizeof *pc->lifeTime);
+  return h;
+}
+
+void gameFree(Game *game) {
+  freeJobs(game->jobs);
+  free(game->jobs);
+  game->jobs = NULL;
+  free(game->flow);
+  game->flow = NULL;
+  freeRoomStore(game->rooms);
+  free(game->rooms);
+  game->rooms = NULL;
+  unloadRoomPack(game->pack);
+  free(game->pack);
+  game->pack = NULL;
+  freeProjectiles(&game->pc);
+}
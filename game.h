@@ -0,0 +1,190 @@
+#ifndef GAME_H
+#define GAME_H
+
+// only the types (Vector2, Color) are used from raylib here, so the
+// simulation can be built and linked without raylib, X11 or a GPU
+#include "raylib.h"
+#include <stdbool.h>
+
+/*
+ * bubbles moving this much further than their diameter in a step could
+ * jump over a wall between two steps, so their moves are swept
+ */
+#define SWEEP_MIN_MOVE WALL_THICKNESS
+// starting capacity of the projectile store, it grows when full
+#define PROJECTILE_CAPACITY 64
+// overridable so tools like the benchmark can hold more entities
+#ifndef MAX_ENEMIES
+#define MAX_ENEMIES 50
+#endif
+/*
+ * the world is simulated and drawn in base pixels, the window scales the
+ * finished frame up (see SPRUTTE_SCALE in main.c)
+ */
+#define WALL_THICKNESS 9
+#define BLOCK_SIZE 50
+#define DOORSIZE BLOCK_SIZE
+#define STARTING_PLAYER_RADIUS ((BLOCK_SIZE / 2) - 10)
+#define TILES_X 11
+#define TILES_Y 7
+#define MAX_BLOCKS (8 + TILES_X * TILES_Y)
+#define SCREEN_WIDTH (BLOCK_SIZE * TILES_X + WALL_THICKNESS * 2)
+#define SCREEN_HEIGHT (BLOCK_SIZE * TILES_Y + WALL_THICKNESS * 2)
+/*
+ * the simulation runs in fixed steps of SIM_DT seconds whatever the display
+ * rate, speeds, fire rates and lifetimes are counted per step
+ */
+#define SIM_HZ 60
+#define SIM_DT (1.0 / SIM_HZ)
+// longest frame time caught up on at once
+#define MAX_FRAME_TIME 0.25
+// steps between the coarse ticks of the rooms the player is not in
+#define ROOM_TICK_STEPS 30
+// room pack loaded when no other map is given, built by make from map.txt
+#define MAP_PATH "map.pack"
+
+// input bits, one per key the game reacts to
+#define INPUT_MOVE_UP (1 << 0)
+#define INPUT_MOVE_DOWN (1 << 1)
+#define INPUT_MOVE_LEFT (1 << 2)
+#define INPUT_MOVE_RIGHT (1 << 3)
+#define INPUT_SHOOT_UP (1 << 4)
+#define INPUT_SHOOT_DOWN (1 << 5)
+#define INPUT_SHOOT_LEFT (1 << 6)
+#define INPUT_SHOOT_RIGHT (1 << 7)
+
+typedef unsigned int Input;
+
+/*
+ * where the input for each simulated frame comes from,
+ * e.g. the keyboard or a scripted sequence
+ */
+typedef struct InputSource {
+  Input (*poll)(void *ctx);
+  void *ctx;
+} InputSource;
+
+typedef struct Character {
+  Vector2 position;
+  float speed;
+  int radius;
+  unsigned int firerate;
+  unsigned int shotCharge;
+  float shotSpeed;
+  bool alive;
+} Character;
+
+/*
+ * struct of arrays holding the live projectiles (bubbles)
+ * the first count entries are live, despawning swaps the last one into the
+ * hole, so loops only ever touch live bubbles
+ */
+typedef struct ProjectilesContainer {
+  float *x;
+  float *y;
+  float *prevX; // position before the last step, for interpolated drawing
+  float *prevY;
+  float *speedX;
+  float *speedY;
+  int *radius;
+  int *lifeTime;
+  unsigned char *hit; // scratch for the collision passes
+  int count;
+  int capacity;
+} ProjectilesContainer;
+
+/*
+ * struct of arrays holding the live enemies, packed like the projectiles,
+ * so a pass over them costs as much as there are enemies, not MAX_ENEMIES
+ */
+typedef struct EnemiesContainer {
+  float x[MAX_ENEMIES];
+  float y[MAX_ENEMIES];
+  float prevX[MAX_ENEMIES]; // position before the last step
+  float prevY[MAX_ENEMIES];
+  float speed[MAX_ENEMIES];
+  int radius[MAX_ENEMIES];
+  int count;
+} EnemiesContainer;
+
+/*
+ * what lives in a room, kept by the room while the player is elsewhere
+ * the room the player is in is simulated in Game.enemies and Game.pc,
+ * and handed back here when the player leaves
+ */
+typedef struct RoomState {
+  EnemiesContainer enemies;
+  ProjectilesContainer pc; // no arrays until bubbles are left in the room
+  long lastStep;           // step the state is simulated up to
+} RoomState;
+
+// Maybe 11 x  7
+typedef struct Block {
+  Vector2 start;
+  Vector2 size;
+  bool enabled; // false for the empty tiles of a room
+} Block;
+
+typedef struct Room {
+  Block *blocks;
+  bool enabled;
+  Color color;
+  RoomState *state;
+} Room;
+
+// everything the simulation needs, no window or rendering state
+typedef struct Game {
+  Character player;
+  EnemiesContainer enemies;
+  Vector2 prevPlayer; // position before the last step
+  ProjectilesContainer pc;
+  struct RoomPack *pack;   // the rooms as stored on disk
+  struct RoomStore *rooms; // the rooms built so far, within a memory budget
+  struct FlowField *flow;  // paths to the player in the current room
+  struct JobSystem *jobs;  // threads for the rooms the player is not in
+  int curRoom;
+  long step;          // steps simulated so far
+  double accumulator; // time not yet simulated, less than SIM_DT
+} Game;
+
+int nearbyBlocks(Block *blocks, Vector2 lo, Vector2 hi, int rad, int *out);
+void initProjectiles(ProjectilesContainer *pc, int capacity);
+void freeProjectiles(ProjectilesContainer *pc);
+void despawnProjectile(ProjectilesContainer *pc, int i);
+void shoot(float xSpeed, float ySpeed, Vector2 origin,
+           ProjectilesContainer *pc);
+void playerShoot(Character *player, ProjectilesContainer *pc, Input input);
+void updateProjectiles(ProjectilesContainer *pc, Block blocks[],
+                       const EnemiesContainer *enemies);
+void resetProjectiles(ProjectilesContainer *pc);
+void copyProjectiles(ProjectilesContainer *dst,
+                     const ProjectilesContainer *src);
+void updatePos(Character *player, Block *blocks, Vector2 newPos);
+int playerMove(Character *player, Room room, Input input);
+int spawnEnemy(EnemiesContainer *ec, Vector2 pos, float speed, int radius);
+void despawnEnemy(EnemiesContainer *ec, int i);
+void copyEnemies(EnemiesContainer *dst, const EnemiesContainer *src);
+struct FlowField;
+void moveEnemies(EnemiesContainer *ec, Character player, Block *blocks,
+                 const struct FlowField *flow);
+void makeWall(bool *adjacentDoors, Block *blocks);
+Block makeBlock(int x, int y);
+void readRoom(char *fname, char *buf);
+Room makeRoomFromLayout(Block *blocks, bool up, bool down, bool left,
+                        bool right, const char *layout, Color color);
+
+Room *getRoom(Game *game, int roomIdx);
+Room *enterRoom(Game *game, int roomIdx);
+void catchUpProjectiles(ProjectilesContainer *pc, Block *blocks, long steps);
+void leaveRoomState(Game *game, RoomState *state);
+void takeRoomState(Game *game, RoomState *state, Block *blocks);
+void tickRooms(Game *game);
+void gameInit(Game *game, const char *mapPath);
+void savePositions(Game *game);
+void gameStep(Game *game, Input input);
+float gameAdvance(Game *game, double frameTime, InputSource source);
+Vector2 lerpPosition(Vector2 prev, Vector2 cur, float alpha);
+unsigned long long hashGame(const Game *game);
+void gameFree(Game *game);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Runs the simulation without a window, GPU or keyboard, driven by a
+ * scripted input source, and reports how fast the frames were stepped.
+ *
+ * usage: ./headless [frames] [seed] [map.pack]
+ *        ./headless replay recording [map.pack]
+ *
+ * the second form plays back an input recording made with ./main instead,
+ * for every frame it holds
+ * both print a hash of the final state, which has to stay the same when
+ * the simulation is only made faster
+ * map.pack can also be seed:<n>[:<width>x<height>], for a generated map
+ * with SPRUTTE_PROFILE set, the time of each system is printed as well
+ */
+#include "game.h"
+#include "profiler.h"
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Script {
+  unsigned long long state;
+  unsigned long frame;
+  Input current;
+} Script;
+
+// input source that holds a pseudo random set of keys for 30 frames at a time
+Input scriptedInput(void *ctx) {
+  Script *script = ctx;
+  if (script->frame % 30 == 0) {
+    script->state = script->state * 6364136223846793005ULL +
+                    1442695040888963407ULL;
+    script->current = (script->state >> 33) & 0xff;
+  }
+  script->frame++;
+  return script->current;
+}
+
+int main(int argc, char **argv) {
+  Script script = {1, 0, 0};
+  Replay replay = {0};
+  InputSource source = {scriptedInput, &script};
+  long frames = 100000;
+  const char *mapPath = MAP_PATH;
+  if (argc > 1 && strcmp(argv[1], "replay") == 0) {
+    if (argc < 3) {
+      fprintf(stderr, "usage: %s replay recording [map.pack]\n", argv[0]);
+      return 1;
+    }
+    loadReplay(&replay, argv[2]);
+    source = (InputSource){replayInput, &replay};
+    frames = replay.frames;
+    mapPath = argc > 3 ? argv[3] : MAP_PATH;
+  } else {
+    frames = argc > 1 ? atol(argv[1]) : frames;
+    script.state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    mapPath = argc > 3 ? argv[3] : MAP_PATH;
+  }
+  if (frames < 1) {
+    fprintf(stderr, "frames must be positive\n");
+    return 1;
+  }
+
+  Game game;
+  gameInit(&game, mapPath);
+
+  double start = monotonicTime();
+  setProfiling(getenv("SPRUTTE_PROFILE") != NULL);
+  for (long i = 0; i < frames; i++) {
+    double inputStart = profileBegin();
+    Input input = source.poll(source.ctx);
+    profileEnd(PROFILE_INPUT, inputStart);
+    gameStep(&game, input);
+  }
+  double elapsed = monotonicTime() - start;
+
+  printf("frames:     %ld\n", frames);
+  printf("time:       %.3f s\n", elapsed);
+  printf("ns/frame:   %.1f\n", elapsed * 1e9 / frames);
+  printf("frames/sec: %.0f\n", frames / elapsed);
+  // each frame is one fixed step of simulated time
+  printf("sim time:   %.1f s, %.0fx real time\n", frames * SIM_DT,
+         frames * SIM_DT / elapsed);
+  printf("room:       %d\n", game.curRoom);
+  printf("player:     %.1f %.1f\n", game.player.position.x,
+         game.player.position.y);
+  printf("state hash: %016llx\n", hashGame(&game));
+  if (profiling()) {
+    printProfile(stdout);
+  }
+
+  gameFree(&game);
+  freeReplay(&replay);
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct Worker {
+  JobSystem *js;
+  int index;
+} Worker;
+
+// worker threads to start, SPRUTTE_THREADS or one less than the cores
+int jobThreads(void) {
+  const char *env = getenv("SPRUTTE_THREADS");
+  long threads = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  return threads > 1 ? threads - 1 : 0;
+}
+
+// the next job of the worker owning q, or -1
+int popJob(JobQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  int job = q->head < q->tail ? q->jobs[--q->tail] : -1;
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+// the oldest job of another worker, or -1
+int stealJob(JobQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  int job = q->head < q->tail ? q->jobs[q->head++] : -1;
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+// run jobs until no queue has any left, no jobs are added during a batch
+void workOn(JobSystem *js, int self) {
+  int queues = js->workers + 1;
+  for (;;) {
+    int job = popJob(&js->queues[self]);
+    for (int i = 1; i < queues && job == -1; i++) {
+      job = stealJob(&js->queues[(self + i) % queues]);
+    }
+    if (job == -1) {
+      return;
+    }
+    js->fn(js->ctx, job);
+  }
+}
+
+void *jobWorker(void *arg) {
+  Worker *w = arg;
+  JobSystem *js = w->js;
+  int seen = 0;
+  pthread_mutex_lock(&js->lock);
+  for (;;) {
+    while (js->generation == seen && !js->quit) {
+      pthread_cond_wait(&js->start, &js->lock);
+    }
+    if (js->quit) {
+      break;
+    }
+    seen = js->generation;
+    pthread_mutex_unlock(&js->lock);
+    workOn(js, w->index);
+    pthread_mutex_lock(&js->lock);
+    if (--js->busy == 0) {
+      pthread_cond_signal(&js->done);
+    }
+  }
+  pthread_mutex_unlock(&js->lock);
+  free(w);
+  return NULL;
+}
+
+void initJobs(JobSystem *js, int workers) {
+  *js = (JobSystem){0};
+  js->workers = workers;
+  js->threads = malloc(workers * sizeof *js->threads);
+  js->queues = calloc(workers + 1, sizeof *js->queues);
+  for (int i = 0; i <= workers; i++) {
+    pthread_mutex_init(&js->queues[i].lock, NULL);
+  }
+  pthread_mutex_init(&js->lock, NULL);
+  pthread_cond_init(&js->start, NULL);
+  pthread_cond_init(&js->done, NULL);
+  for (int i = 0; i < workers; i++) {
+    Worker *w = malloc(sizeof *w);
+    *w = (Worker){js, i};
+    if (pthread_create(&js->threads[i], NULL, jobWorker, w) != 0) {
+      perror("Failed starting job worker");
+      exit(1);
+    }
+  }
+}
+
+/*
+ * run fn(ctx, i) for every i below count, spread over the workers, and
+ * wait for all of them
+ */
+void runJobs(JobSystem *js, JobFn fn, void *ctx, int count) {
+  if (js->workers == 0 || count < 2) {
+    for (int i = 0; i < count; i++) {
+      fn(ctx, i);
+    }
+    return;
+  }
+
+  // deal the jobs out in contiguous runs, the workers are all idle here
+  int queues = js->workers + 1;
+  for (int q = 0; q < queues; q++) {
+    JobQueue *queue = &js->queues[q];
+    int first = (long)count * q / queues;
+    int last = (long)count * (q + 1) / queues;
+    if (queue->capacity < last - first) {
+      queue->capacity = last - first;
+      queue->jobs = realloc(queue->jobs, queue->capacity * sizeof(int));
+    }
+    for (int i = first; i < last; i++) {
+      queue->jobs[i - first] = i;
+    }
+    queue->head = 0;
+    queue->tail = last - first;
+  }
+
+  pthread_mutex_lock(&js->lock);
+  js->fn = fn;
+  js->ctx = ctx;
+  js->busy = js->workers;
+  js->generation++;
+  pthread_cond_broadcast(&js->start);
+  pthread_mutex_unlock(&js->lock);
+
+  workOn(js, js->workers);
+
+  pthread_mutex_lock(&js->lock);
+  while (js->busy > 0) {
+    pthread_cond_wait(&js->done, &js->lock);
+  }
+  pthread_mutex_unlock(&js->lock);
+}
+
+void freeJobs(JobSystem *js) {
+  pthread_mutex_lock(&js->lock);
+  js->quit = true;
+  pthread_cond_broadcast(&js->start);
+  pthread_mutex_unlock(&js->lock);
+  for (int i = 0; i < js->workers; i++) {
+    pthread_join(js->threads[i], NULL);
+  }
+  for (int i = 0; i <= js->workers; i++) {
+    pthread_mutex_destroy(&js->queues[i].lock);
+    free(js->queues[i].jobs);
+  }
+  pthread_mutex_destroy(&js->lock);
+  pthread_cond_destroy(&js->start);
+  pthread_cond_destroy(&js->done);
+  free(js->queues);
+  free(js->threads);
+  *js = (JobSystem){0};
+}
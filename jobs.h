@@ -0,0 +1,45 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// work on job i of a batch, with the context the batch was started with
+typedef void (*JobFn)(void *ctx, int i);
+
+// jobs of a worker, it takes from the back, idle workers steal the front
+typedef struct JobQueue {
+  pthread_mutex_t lock;
+  int *jobs;
+  int capacity;
+  int head;
+  int tail;
+} JobQueue;
+
+/*
+ * pool of worker threads running batches of independent jobs
+ * a batch is spread over the queues up front, and a worker that runs out
+ * steals from the others, so uneven jobs still keep every core busy
+ * the thread starting a batch works on it too and returns once all of it
+ * is done
+ */
+typedef struct JobSystem {
+  int workers;       // threads besides the one starting batches
+  pthread_t *threads;
+  JobQueue *queues;  // one per worker, and the last for the caller
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  JobFn fn;
+  void *ctx;
+  int generation; // batches started so far
+  int busy;       // workers still on the current batch
+  bool quit;
+} JobSystem;
+
+int jobThreads(void);
+void initJobs(JobSystem *js, int workers);
+void runJobs(JobSystem *js, JobFn fn, void *ctx, int count);
+void freeJobs(JobSystem *js);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Converts a text map and room layouts into a binary room pack.
+ *
+ * usage: ./makepack map.txt out.pack layout.txt [layout.txt ...]
+ *
+ * map.txt has one line per row of rooms, with one character per room:
+ *   '.' no room, '#' a room, '@' the room the player starts in
+ * each layout file holds the TILES_X * TILES_Y '0'/'1' tiles of a room, like
+ * test.txt, and the rooms use them in turn
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "roompack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool isRoom(const char *cells, size_t width, size_t x, size_t y) {
+  return cells[y * width + x] != '.';
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s map.txt out.pack layout.txt...\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(argv[1], "r");
+  if (file == NULL) {
+    perror("Failed reading map");
+    return 1;
+  }
+  // rooms as read, width grows to the longest line
+  char *cells = NULL;
+  size_t width = 0;
+  size_t height = 0;
+  char *line = NULL;
+  size_t lineCap = 0;
+  ssize_t len;
+  while ((len = getline(&line, &lineCap, file)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      len--;
+    }
+    if ((size_t)len > width) {
+      // widen every row read so far
+      char *wider = malloc(len * (height + 1));
+      memset(wider, '.', len * (height + 1));
+      for (size_t y = 0; y < height; y++) {
+        memcpy(wider + y * len, cells + y * width, width);
+      }
+      free(cells);
+      cells = wider;
+      width = len;
+    } else {
+      cells = realloc(cells, width * (height + 1));
+      memset(cells + height * width, '.', width);
+    }
+    memcpy(cells + height * width, line, len);
+    height++;
+  }
+  free(line);
+  fclose(file);
+  if (width == 0 || height == 0) {
+    fprintf(stderr, "Map %s is empty\n", argv[1]);
+    return 1;
+  }
+
+  int nLayouts = argc - 3;
+  char(*layouts)[TILES_X * TILES_Y + 1] = calloc(nLayouts, sizeof *layouts);
+  for (int i = 0; i < nLayouts; i++) {
+    readRoom(argv[3 + i], layouts[i]);
+  }
+
+  int rooms = 0;
+  int start = -1;
+  for (size_t i = 0; i < width * height; i++) {
+    rooms += cells[i] != '.';
+    if (cells[i] == '@') {
+      start = rooms - 1;
+    }
+  }
+  if (rooms == 0) {
+    fprintf(stderr, "Map %s has no rooms\n", argv[1]);
+    return 1;
+  }
+
+  RoomPack pack = allocRoomPack(width, height, rooms);
+  PackRoom *room = packRooms(&pack);
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      if (!isRoom(cells, width, x, y)) {
+        continue;
+      }
+      room->x = x;
+      room->y = y;
+      // doors to the neighbouring rooms
+      if (y > 0 && isRoom(cells, width, x, y - 1)) {
+        room->doors |= DOOR_UP;
+      }
+      if (y + 1 < height && isRoom(cells, width, x, y + 1)) {
+        room->doors |= DOOR_DOWN;
+      }
+      if (x > 0 && isRoom(cells, width, x - 1, y)) {
+        room->doors |= DOOR_LEFT;
+      }
+      if (x + 1 < width && isRoom(cells, width, x + 1, y)) {
+        room->doors |= DOOR_RIGHT;
+      }
+      const char *layout = layouts[(room - packRooms(&pack)) % nLayouts];
+      for (int i = 0; i < TILES_X * TILES_Y; i++) {
+        if (layout[i] == '1') {
+          room->tiles[i / 8] |= 1 << (i % 8);
+        }
+      }
+      room++;
+    }
+  }
+  indexRoomPack(&pack);
+  linkRoomPack(&pack, 0, rooms);
+
+  // without an '@', the room in the middle of the map, or else the first
+  if (start < 0) {
+    start = packFindRoom(&pack, width / 2, height / 2);
+  }
+  pack.header.start = start < 0 ? 0 : start;
+  writeRoomPack(&pack, argv[2]);
+  unloadRoomPack(&pack);
+
+  printf("%s: %zux%zu map, %d rooms\n", argv[2], width, height, rooms);
+  free(layouts);
+  free(cells);
+  return 0;
+}
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 199309L
+#include "profiler.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * a ring of the latest samples per system, in nanoseconds
+ * each system is timed on one thread only, while the overlay may read the
+ * statistics from another, so the samples are atomics
+ */
+static atomic_bool enabled;
+static atomic_uint samples[PROFILE_SYSTEMS][PROFILE_FRAMES];
+static atomic_uint taken[PROFILE_SYSTEMS]; // samples ever taken, mod 2^32
+
+double monotonicTime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setProfiling(bool on) { atomic_store(&enabled, on); }
+
+bool profiling(void) {
+  return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+// start of a timed stage, 0 when not profiling
+double profileBegin(void) { return profiling() ? monotonicTime() : 0; }
+
+void profileEnd(ProfileSystem system, double start) {
+  if (start == 0) {
+    return;
+  }
+  unsigned int ns = (monotonicTime() - start) * 1e9;
+  unsigned int i = atomic_load_explicit(&taken[system], memory_order_relaxed);
+  atomic_store_explicit(&samples[system][i % PROFILE_FRAMES], ns,
+                        memory_order_relaxed);
+  atomic_store_explicit(&taken[system], i + 1, memory_order_release);
+}
+
+const char *profileSystemName(ProfileSystem system) {
+  static const char *names[PROFILE_SYSTEMS] = {
+      "input",       "playerMove", "playerShoot", "updateProjectiles",
+      "moveEnemies", "tickRooms",  "doDraw",      "captureFrame"};
+  return names[system];
+}
+
+int compareUints(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+ProfileStats profileStats(ProfileSystem system) {
+  unsigned int n = atomic_load_explicit(&taken[system], memory_order_acquire);
+  if (n > PROFILE_FRAMES) {
+    n = PROFILE_FRAMES;
+  }
+  ProfileStats stats = {n, 0, 0, 0};
+  if (n == 0) {
+    return stats;
+  }
+  unsigned int sorted[PROFILE_FRAMES];
+  double total = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    sorted[i] = atomic_load_explicit(&samples[system][i],
+                                     memory_order_relaxed);
+    total += sorted[i];
+  }
+  qsort(sorted, n, sizeof *sorted, compareUints);
+  stats.min = sorted[0] / 1e3;
+  stats.avg = total / n / 1e3;
+  stats.p99 = sorted[(n - 1) * 99 / 100] / 1e3;
+  return stats;
+}
+
+void printProfile(FILE *out) {
+  fprintf(out, "%-18s %8s %10s %10s %10s\n", "system", "samples", "min us",
+          "avg us", "p99 us");
+  for (int s = 0; s < PROFILE_SYSTEMS; s++) {
+    ProfileStats stats = profileStats(s);
+    fprintf(out, "%-18s %8d %10.2f %10.2f %10.2f\n", profileSystemName(s),
+            stats.samples, stats.min, stats.avg, stats.p99);
+  }
+}
+
+void writeProfileCsv(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror("Failed writing profile");
+    return;
+  }
+  fprintf(file, "system,samples,min_us,avg_us,p99_us\n");
+  for (int s = 0; s < PROFILE_SYSTEMS; s++) {
+    ProfileStats stats = profileStats(s);
+    fprintf(file, "%s,%d,%.3f,%.3f,%.3f\n", profileSystemName(s),
+            stats.samples, stats.min, stats.avg, stats.p99);
+  }
+  fclose(file);
+}
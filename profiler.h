@@ -0,0 +1,43 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// how many of the latest samples of each system the statistics cover
+#define PROFILE_FRAMES 240
+// written when the game exits
+#define PROFILE_PATH "profile.csv"
+
+// the stages of a frame that are timed
+typedef enum ProfileSystem {
+  PROFILE_INPUT,
+  PROFILE_PLAYER_MOVE,
+  PROFILE_PLAYER_SHOOT,
+  PROFILE_PROJECTILES,
+  PROFILE_ENEMIES,
+  PROFILE_ROOMS,
+  PROFILE_DRAW,
+  PROFILE_CAPTURE,
+  PROFILE_SYSTEMS
+} ProfileSystem;
+
+// over the last PROFILE_FRAMES samples, in microseconds
+typedef struct ProfileStats {
+  int samples;
+  double min;
+  double avg;
+  double p99;
+} ProfileStats;
+
+double monotonicTime(void);
+void setProfiling(bool on);
+bool profiling(void);
+double profileBegin(void);
+void profileEnd(ProfileSystem system, double start);
+const char *profileSystemName(ProfileSystem system);
+ProfileStats profileStats(ProfileSystem system);
+void printProfile(FILE *out);
+void writeProfileCsv(const char *path);
+
+#endif
@@ -0,0 +1,108 @@
+#include "replay.h"
+#include <stdlib.h>
+#include <string.h>
+
+void replayError(const char *path, const char *msg) {
+  fprintf(stderr, "Failed reading recording %s: %s\n", path, msg);
+  exit(1);
+}
+
+void openRecorder(Recorder *rec, const char *path, InputSource source) {
+  *rec = (Recorder){source, fopen(path, "wb"), 0, 0, 0};
+  if (rec->file == NULL) {
+    perror("Failed writing recording");
+    exit(1);
+  }
+  // the frame count is filled in when the recording is closed
+  ReplayHeader header = {REPLAY_MAGIC, REPLAY_VERSION, 0};
+  fwrite(&header, sizeof header, 1, rec->file);
+}
+
+void writeRun(Recorder *rec) {
+  unsigned char run[3] = {rec->run, rec->runLength & 0xff,
+                          rec->runLength >> 8};
+  fwrite(run, sizeof run, 1, rec->file);
+}
+
+Input recordedInput(void *ctx) {
+  Recorder *rec = ctx;
+  Input input = rec->source.poll(rec->source.ctx) & 0xff;
+  if (rec->runLength > 0 &&
+      (input != rec->run || rec->runLength == REPLAY_MAX_RUN)) {
+    writeRun(rec);
+    rec->runLength = 0;
+  }
+  rec->run = input;
+  rec->runLength++;
+  rec->frames++;
+  return input;
+}
+
+void closeRecorder(Recorder *rec) {
+  if (rec->runLength > 0) {
+    writeRun(rec);
+  }
+  ReplayHeader header = {REPLAY_MAGIC, REPLAY_VERSION, rec->frames};
+  fseek(rec->file, 0, SEEK_SET);
+  fwrite(&header, sizeof header, 1, rec->file);
+  if (fclose(rec->file) != 0) {
+    perror("Failed writing recording");
+    exit(1);
+  }
+  rec->file = NULL;
+}
+
+void loadReplay(Replay *replay, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    perror("Failed reading recording");
+    exit(1);
+  }
+  ReplayHeader header;
+  if (fread(&header, sizeof header, 1, file) != 1 ||
+      memcmp(header.magic, REPLAY_MAGIC, 4) != 0) {
+    replayError(path, "not a recording");
+  }
+  if (header.version != REPLAY_VERSION) {
+    replayError(path, "unsupported version");
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file) - sizeof header;
+  fseek(file, sizeof header, SEEK_SET);
+
+  *replay = (Replay){malloc(size > 0 ? size : 1), size / 3, 0, 0,
+                     header.frames};
+  if (fread(replay->runs, 1, size, file) != (size_t)size) {
+    replayError(path, "truncated");
+  }
+  fclose(file);
+  // the runs have to add up to the frame count
+  unsigned long frames = 0;
+  for (size_t i = 0; i < replay->nRuns; i++) {
+    unsigned char *run = replay->runs + 3 * i;
+    frames += run[1] | run[2] << 8;
+  }
+  if (frames != header.frames) {
+    replayError(path, "truncated");
+  }
+}
+
+// the next recorded input, nothing pressed once the recording has ended
+Input replayInput(void *ctx) {
+  Replay *replay = ctx;
+  while (replay->run < replay->nRuns) {
+    unsigned char *run = replay->runs + 3 * replay->run;
+    if (replay->used < (unsigned int)(run[1] | run[2] << 8)) {
+      replay->used++;
+      return run[0];
+    }
+    replay->run++;
+    replay->used = 0;
+  }
+  return 0;
+}
+
+void freeReplay(Replay *replay) {
+  free(replay->runs);
+  replay->runs = NULL;
+}
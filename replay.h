@@ -0,0 +1,53 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "game.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Input recording, the input bits of every simulation step:
+ *
+ *   ReplayHeader
+ *   runs of the same input, each 3 bytes:
+ *     1 byte of input bits, 2 bytes (little endian) of how many steps in a row
+ *
+ * the simulation is deterministic, so replaying a recording on the same map
+ * ends in the same state
+ */
+#define REPLAY_MAGIC "SPRI"
+#define REPLAY_VERSION 1
+#define REPLAY_MAX_RUN 0xffff
+
+typedef struct ReplayHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t frames;
+} ReplayHeader;
+
+// input source that writes down every input it passes on from source
+typedef struct Recorder {
+  InputSource source;
+  FILE *file;
+  Input run; // input of the run being counted
+  unsigned int runLength;
+  uint32_t frames;
+} Recorder;
+
+// input source that plays a recording back
+typedef struct Replay {
+  unsigned char *runs;
+  size_t nRuns;
+  size_t run;
+  unsigned int used; // steps taken from the current run
+  uint32_t frames;
+} Replay;
+
+void openRecorder(Recorder *rec, const char *path, InputSource source);
+Input recordedInput(void *ctx);
+void closeRecorder(Recorder *rec);
+void loadReplay(Replay *replay, const char *path);
+Input replayInput(void *ctx);
+void freeReplay(Replay *replay);
+
+#endif
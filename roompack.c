@@ -0,0 +1,212 @@
+#include "roompack.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bytes taken by a pack of the given number of rooms and table slots
+size_t packSize(size_t rooms, size_t tableSize) {
+  return sizeof(PackHeader) + rooms * sizeof(PackRoom) +
+         tableSize * sizeof(uint32_t);
+}
+
+void packError(const char *path, const char *msg) {
+  fprintf(stderr, "Failed reading room pack %s: %s\n", path, msg);
+  exit(1);
+}
+
+/*
+ * map the pack at path into memory and check its header
+ * the rooms are not touched until they are asked for
+ */
+RoomPack loadRoomPack(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed opening room pack");
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror("Failed reading room pack");
+    exit(1);
+  }
+  if ((size_t)st.st_size < sizeof(PackHeader)) {
+    packError(path, "too small");
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the file is closed
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("Failed mapping room pack");
+    exit(1);
+  }
+
+  RoomPack pack = {data, st.st_size, {{0}, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+  memcpy(&pack.header, data, sizeof pack.header);
+  PackHeader *h = &pack.header;
+  if (memcmp(h->magic, PACK_MAGIC, 4) != 0) {
+    packError(path, "not a room pack");
+  }
+  if (h->version != PACK_VERSION) {
+    packError(path, "unsupported version");
+  }
+  if (h->tilesX != TILES_X || h->tilesY != TILES_Y ||
+      h->recordSize != sizeof(PackRoom)) {
+    packError(path, "rooms have the wrong number of tiles");
+  }
+  if (h->rooms > INT_MAX || h->tableSize < 2 * (size_t)h->rooms ||
+      (h->tableSize & (h->tableSize - 1)) != 0) {
+    packError(path, "bad room table");
+  }
+  if (pack.size < packSize(h->rooms, h->tableSize)) {
+    packError(path, "truncated");
+  }
+  if (h->start >= h->rooms) {
+    packError(path, "bad starting room");
+  }
+  return pack;
+}
+
+void unloadRoomPack(RoomPack *pack) {
+  munmap((void *)pack->data, pack->size);
+  pack->data = NULL;
+}
+
+const PackRoom *packRoom(const RoomPack *pack, int roomIdx) {
+  return (const PackRoom *)(pack->data + sizeof(PackHeader)) + roomIdx;
+}
+
+const uint32_t *packTable(const RoomPack *pack) {
+  return (const uint32_t *)(pack->data + sizeof(PackHeader) +
+                            (size_t)pack->header.rooms * sizeof(PackRoom));
+}
+
+// the room behind the door on the given side, or -1 if there is none
+int packNeighbour(const RoomPack *pack, int roomIdx, int side) {
+  uint32_t link = packRoom(pack, roomIdx)->links[side];
+  return link < pack->header.rooms ? (int)link : -1;
+}
+
+uint32_t positionHash(int x, int y) {
+  uint32_t h = (uint32_t)x * 0x9e3779b1u ^ (uint32_t)y * 0x85ebca77u;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  return h ^ (h >> 13);
+}
+
+// the room at x, y on the map, or -1 if there is none
+int packFindRoom(const RoomPack *pack, int x, int y) {
+  const uint32_t *table = packTable(pack);
+  uint32_t mask = pack->header.tableSize - 1;
+  for (uint32_t i = positionHash(x, y) & mask;; i = (i + 1) & mask) {
+    uint32_t roomIdx = table[i];
+    if (roomIdx >= pack->header.rooms) {
+      return -1;
+    }
+    const PackRoom *room = packRoom(pack, roomIdx);
+    if (room->x == x && room->y == y) {
+      return roomIdx;
+    }
+  }
+}
+
+// build a room from its record into blocks
+Room makeRoomFromPack(const RoomPack *pack, int roomIdx, Color color,
+                      Block *blocks) {
+  const PackRoom *record = packRoom(pack, roomIdx);
+  unsigned char doors = record->doors;
+
+  char layout[TILES_X * TILES_Y + 1];
+  for (int i = 0; i < TILES_X * TILES_Y; i++) {
+    layout[i] = (record->tiles[i / 8] >> (i % 8)) & 1 ? '1' : '0';
+  }
+  layout[TILES_X * TILES_Y] = '\0';
+
+  return makeRoomFromLayout(blocks, doors & DOOR_UP, doors & DOOR_DOWN,
+                            doors & DOOR_LEFT, doors & DOOR_RIGHT, layout,
+                            color);
+}
+
+/*
+ * an empty pack of the given number of rooms, in anonymous memory that
+ * comes zeroed, with the hash table still to be built
+ */
+RoomPack allocRoomPack(int width, int height, int rooms) {
+  if (rooms > 1 << 30) {
+    fprintf(stderr, "Failed allocating room pack: too many rooms\n");
+    exit(1);
+  }
+  uint32_t tableSize = 2;
+  while (tableSize < 2 * (size_t)rooms) {
+    tableSize *= 2;
+  }
+  size_t size = packSize(rooms, tableSize);
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    perror("Failed allocating room pack");
+    exit(1);
+  }
+  PackHeader header = {PACK_MAGIC, PACK_VERSION, TILES_X,   TILES_Y,
+                       width,      height,       rooms,     0,
+                       sizeof(PackRoom),         tableSize};
+  memcpy(data, &header, sizeof header);
+  return (RoomPack){data, size, header};
+}
+
+// the rooms of a pack being built, which is the only one writing them
+PackRoom *packRooms(RoomPack *pack) {
+  return (PackRoom *)(pack->data + sizeof(PackHeader));
+}
+
+void indexRoomPack(RoomPack *pack) {
+  uint32_t *table = (uint32_t *)packTable(pack);
+  uint32_t mask = pack->header.tableSize - 1;
+  memset(table, 0xff, pack->header.tableSize * sizeof *table);
+  for (uint32_t r = 0; r < pack->header.rooms; r++) {
+    const PackRoom *room = packRoom(pack, r);
+    uint32_t i = positionHash(room->x, room->y) & mask;
+    while (table[i] != PACK_NO_ROOM) {
+      i = (i + 1) & mask;
+    }
+    table[i] = r;
+  }
+}
+
+void linkRoomPack(RoomPack *pack, int first, int last) {
+  int dx[SIDES] = {0, 0, -1, 1};
+  int dy[SIDES] = {-1, 1, 0, 0};
+  for (int r = first; r < last; r++) {
+    PackRoom *room = packRooms(pack) + r;
+    for (int side = 0; side < SIDES; side++) {
+      int other = -1;
+      if (room->doors & (1 << side)) {
+        other = packFindRoom(pack, room->x + dx[side], room->y + dy[side]);
+      }
+      if (other < 0) {
+        room->doors &= ~(1 << side);
+      }
+      room->links[side] = other < 0 ? PACK_NO_ROOM : (uint32_t)other;
+    }
+  }
+}
+
+void writeRoomPack(const RoomPack *pack, const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    perror("Failed writing room pack");
+    exit(1);
+  }
+  // the header as it is now, the start room may have been set after alloc
+  fwrite(&pack->header, sizeof pack->header, 1, out);
+  fwrite(pack->data + sizeof pack->header, 1,
+         pack->size - sizeof pack->header, out);
+  if (fclose(out) != 0) {
+    perror("Failed writing room pack");
+    exit(1);
+  }
+}
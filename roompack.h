@@ -0,0 +1,85 @@
+#ifndef ROOMPACK_H
+#define ROOMPACK_H
+
+#include "game.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary room pack, a whole map in one file:
+ *
+ *   PackHeader
+ *   one PackRoom per room there is, the empty cells of the map take no space
+ *   an open-addressed hash table of tableSize entries from map position to
+ *   room index, PACK_NO_ROOM for free slots
+ *
+ * rooms are numbered by their place in the pack, and each one holds the
+ * numbers of the rooms behind its doors, so moving between rooms needs no
+ * lookup at all
+ *
+ * made from text files by the makepack tool, or generated by dungeon.c
+ */
+#define PACK_MAGIC "SPRP"
+#define PACK_VERSION 2
+#define PACK_TILE_BYTES ((TILES_X * TILES_Y + 7) / 8)
+#define PACK_NO_ROOM UINT32_MAX
+
+// sides of a room, the DOOR_* flag is set when it has a door on that side
+enum { SIDE_UP, SIDE_DOWN, SIDE_LEFT, SIDE_RIGHT, SIDES };
+
+#define DOOR_UP (1 << SIDE_UP)
+#define DOOR_DOWN (1 << SIDE_DOWN)
+#define DOOR_LEFT (1 << SIDE_LEFT)
+#define DOOR_RIGHT (1 << SIDE_RIGHT)
+
+typedef struct PackHeader {
+  char magic[4];
+  uint32_t version;
+  uint16_t tilesX;
+  uint16_t tilesY;
+  uint32_t width;  // size of the map in rooms, empty cells included
+  uint32_t height;
+  uint32_t rooms;  // rooms in the pack
+  uint32_t start;  // the room the player starts in
+  uint32_t recordSize;
+  uint32_t tableSize; // a power of two, at least twice the rooms
+} PackHeader;
+
+typedef struct PackRoom {
+  int32_t x; // position on the map, in rooms
+  int32_t y;
+  uint32_t links[SIDES]; // the room behind each door, or PACK_NO_ROOM
+  unsigned char doors;   // the DOOR_* flags
+  // the tiles as a bitset, tile i is bit i % 8 of byte i / 8, 1 is a block
+  unsigned char tiles[PACK_TILE_BYTES];
+} PackRoom;
+
+// a pack mapped into memory, read only and shared with other processes
+typedef struct RoomPack {
+  const unsigned char *data;
+  size_t size;
+  PackHeader header;
+} RoomPack;
+
+RoomPack loadRoomPack(const char *path);
+void unloadRoomPack(RoomPack *pack);
+const PackRoom *packRoom(const RoomPack *pack, int roomIdx);
+int packNeighbour(const RoomPack *pack, int roomIdx, int side);
+int packFindRoom(const RoomPack *pack, int x, int y);
+Room makeRoomFromPack(const RoomPack *pack, int roomIdx, Color color,
+                      Block *blocks);
+
+/*
+ * building a pack in memory: allocRoomPack makes room for the rooms, the
+ * caller fills in their positions, doors and tiles, then indexRoomPack
+ * builds the hash table and linkRoomPack the links of rooms first to last
+ * (doors that lead nowhere are closed)
+ * the pack is unloaded with unloadRoomPack like a loaded one
+ */
+RoomPack allocRoomPack(int width, int height, int rooms);
+PackRoom *packRooms(RoomPack *pack);
+void indexRoomPack(RoomPack *pack);
+void linkRoomPack(RoomPack *pack, int first, int last);
+void writeRoomPack(const RoomPack *pack, const char *path);
+
+#endif
@@ -0,0 +1,181 @@
+#include "roomstore.h"
+#include <stdlib.h>
+
+void initRoomStore(RoomStore *store, int capacity) {
+  if (capacity < MIN_STORED_ROOMS) {
+    capacity = MIN_STORED_ROOMS;
+  }
+  // keep the table at most half full
+  int tableSize = 1;
+  while (tableSize < capacity * 2) {
+    tableSize *= 2;
+  }
+  size_t roomsSize = capacity * sizeof *store->rooms;
+  size_t blocksSize = (size_t)capacity * MAX_BLOCKS * sizeof *store->blocks;
+  size_t statesSize = capacity * sizeof *store->states;
+  size_t slotSize = capacity * sizeof(int);
+  size_t tableBytes = tableSize * sizeof *store->table;
+  initArena(&store->arena, arenaSize(roomsSize) + arenaSize(blocksSize) +
+                               arenaSize(statesSize) +
+                               5 * arenaSize(slotSize) +
+                               arenaSize(tableBytes));
+  store->rooms = arenaAlloc(&store->arena, roomsSize);
+  store->blocks = arenaAlloc(&store->arena, blocksSize);
+  store->states = arenaAlloc(&store->arena, statesSize);
+  store->roomIdx = arenaAlloc(&store->arena, slotSize);
+  store->prev = arenaAlloc(&store->arena, slotSize);
+  store->next = arenaAlloc(&store->arena, slotSize);
+  store->flying = arenaAlloc(&store->arena, slotSize);
+  store->flyingPos = arenaAlloc(&store->arena, slotSize);
+  for (int i = 0; i < capacity; i++) {
+    store->flyingPos[i] = -1;
+  }
+  store->flyingCount = 0;
+  store->table = arenaAlloc(&store->arena, tableBytes);
+  for (int i = 0; i < tableSize; i++) {
+    store->table[i] = -1;
+  }
+  store->tableMask = tableSize - 1;
+  store->capacity = capacity;
+  store->count = 0;
+  store->head = -1;
+  store->tail = -1;
+}
+
+void freeRoomStore(RoomStore *store) {
+  // bubbles left in a room are the only thing outside the arena
+  for (int i = 0; i < store->count; i++) {
+    freeProjectiles(&store->states[i].pc);
+  }
+  freeArena(&store->arena);
+  *store = (RoomStore){0};
+}
+
+// how many rooms fit in the memory budget
+int roomBudgetCapacity(void) {
+  long budget = ROOM_BUDGET;
+  const char *env = getenv("SPRUTTE_ROOM_BUDGET");
+  if (env) {
+    budget = atol(env);
+  }
+  long perRoom = sizeof(Room) + MAX_BLOCKS * sizeof(Block) +
+                 sizeof(RoomState) + 8 * sizeof(int);
+  long capacity = budget / perRoom;
+  return capacity < MIN_STORED_ROOMS ? MIN_STORED_ROOMS : capacity;
+}
+
+int hashRoom(const RoomStore *store, int roomIdx) {
+  return ((unsigned int)roomIdx * 2654435761u) & store->tableMask;
+}
+
+// position of roomIdx in the table, or of the empty entry where it would go
+int tablePos(const RoomStore *store, int roomIdx) {
+  int pos = hashRoom(store, roomIdx);
+  while (store->table[pos] != -1 &&
+         store->roomIdx[store->table[pos]] != roomIdx) {
+    pos = (pos + 1) & store->tableMask;
+  }
+  return pos;
+}
+
+/*
+ * empty the table entry at pos, moving later entries of the same probe run
+ * back so lookups never stop early at the hole
+ */
+void tableRemove(RoomStore *store, int pos) {
+  int mask = store->tableMask;
+  int hole = pos;
+  for (int i = (pos + 1) & mask; store->table[i] != -1; i = (i + 1) & mask) {
+    int home = hashRoom(store, store->roomIdx[store->table[i]]);
+    // the entry may move to the hole if the hole is between home and i
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      store->table[hole] = store->table[i];
+      hole = i;
+    }
+  }
+  store->table[hole] = -1;
+}
+
+void unlinkSlot(RoomStore *store, int slot) {
+  int prev = store->prev[slot];
+  int next = store->next[slot];
+  if (prev != -1) {
+    store->next[prev] = next;
+  } else {
+    store->head = next;
+  }
+  if (next != -1) {
+    store->prev[next] = prev;
+  } else {
+    store->tail = prev;
+  }
+}
+
+void pushFront(RoomStore *store, int slot) {
+  store->prev[slot] = -1;
+  store->next[slot] = store->head;
+  if (store->head != -1) {
+    store->prev[store->head] = slot;
+  }
+  store->head = slot;
+  if (store->tail == -1) {
+    store->tail = slot;
+  }
+}
+
+// the room at roomIdx if it is built, marked as just used, or NULL
+Room *findRoom(RoomStore *store, int roomIdx) {
+  int slot = store->table[tablePos(store, roomIdx)];
+  if (slot == -1) {
+    return NULL;
+  }
+  if (store->head != slot) {
+    unlinkSlot(store, slot);
+    pushFront(store, slot);
+  }
+  return &store->rooms[slot];
+}
+
+/*
+ * a slot for the room at roomIdx, for the caller to build the room into
+ * the slot's blocks
+ * when full, the least recently used room is thrown out first, so pointers
+ * to other rooms are only good until the next insert
+ */
+Room *insertRoom(RoomStore *store, int roomIdx) {
+  int slot;
+  if (store->count < store->capacity) {
+    slot = store->count++;
+  } else {
+    slot = store->tail;
+    tableRemove(store, tablePos(store, store->roomIdx[slot]));
+    unlinkSlot(store, slot);
+    // the room is forgotten, it starts over when it is built again
+    freeProjectiles(&store->states[slot].pc);
+    setFlying(store, slot, false);
+  }
+  store->states[slot] = (RoomState){0};
+  store->rooms[slot] = (Room){&store->blocks[slot * MAX_BLOCKS], false, RED,
+                              &store->states[slot]};
+  store->roomIdx[slot] = roomIdx;
+  store->table[tablePos(store, roomIdx)] = slot;
+  pushFront(store, slot);
+  return &store->rooms[slot];
+}
+
+/*
+ * add the room in slot to the rooms with bubbles in flight, or take it out
+ * taking out moves the last one into its place
+ */
+void setFlying(RoomStore *store, int slot, bool flying) {
+  int pos = store->flyingPos[slot];
+  if (flying && pos == -1) {
+    store->flyingPos[slot] = store->flyingCount;
+    store->flying[store->flyingCount++] = slot;
+  } else if (!flying && pos != -1) {
+    int last = store->flying[--store->flyingCount];
+    store->flying[pos] = last;
+    store->flyingPos[last] = pos;
+    store->flyingPos[slot] = -1;
+  }
+}
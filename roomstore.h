@@ -0,0 +1,47 @@
+#ifndef ROOMSTORE_H
+#define ROOMSTORE_H
+
+#include "arena.h"
+#include "game.h"
+
+// memory the built rooms may use, unless SPRUTTE_ROOM_BUDGET (bytes) is set
+#define ROOM_BUDGET (4 * 1024 * 1024)
+// the current room and its neighbours always have to fit
+#define MIN_STORED_ROOMS 8
+
+/*
+ * the built rooms of a map, at most capacity of them
+ * rooms are found through an open addressed table from room index to slot,
+ * and kept in least recently used order, so when the store is full the room
+ * that was used the longest ago is thrown out to make space
+ * everything, the blocks of every slot included, lives in one arena, so the
+ * store is released at once and a slot's blocks are reused when its room is
+ * thrown out
+ */
+typedef struct RoomStore {
+  Arena arena;
+  Room *rooms;     // slots
+  Block *blocks;   // MAX_BLOCKS blocks for each slot, one after another
+  RoomState *states; // what lives in each slot's room
+  int *roomIdx;    // room each slot holds
+  int *prev;       // use order, from the newest (head) to the oldest (tail)
+  int *next;
+  int *flying;     // slots of the rooms left with bubbles in flight
+  int *flyingPos;  // where each slot is in flying, -1 when it is not
+  int flyingCount;
+  int *table;      // slot of a room index, -1 when empty
+  int tableMask;   // table size - 1, the size is a power of two
+  int capacity;
+  int count;
+  int head;
+  int tail;
+} RoomStore;
+
+void initRoomStore(RoomStore *store, int capacity);
+void freeRoomStore(RoomStore *store);
+int roomBudgetCapacity(void);
+Room *findRoom(RoomStore *store, int roomIdx);
+Room *insertRoom(RoomStore *store, int roomIdx);
+void setFlying(RoomStore *store, int slot, bool flying);
+
+#endif
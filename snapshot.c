@@ -0,0 +1,54 @@
+#include "snapshot.h"
+#include <string.h>
+
+// copy the state of the last step of game into snap
+void captureSnapshot(Snapshot *snap, Game *game, double stepTime) {
+  snap->stepTime = stepTime;
+  snap->step = game->step;
+  Room *room = getRoom(game, game->curRoom);
+  snap->roomIdx = game->curRoom;
+  snap->roomColor = room->color;
+  memcpy(snap->blocks, room->blocks, sizeof snap->blocks);
+  snap->player = game->player;
+  snap->prevPlayer = game->prevPlayer;
+  copyEnemies(&snap->enemies, &game->enemies);
+  copyProjectiles(&snap->pc, &game->pc);
+}
+
+// every slot starts as a copy of the current state of game
+void initSnapshotBuffer(SnapshotBuffer *buffer, Game *game) {
+  double t = monotonicTime();
+  for (int i = 0; i < 3; i++) {
+    initProjectiles(&buffer->slots[i].pc, PROJECTILE_CAPACITY);
+    captureSnapshot(&buffer->slots[i], game, t);
+  }
+  buffer->back = 0;
+  buffer->front = 1;
+  atomic_init(&buffer->ready, 2);
+}
+
+void freeSnapshotBuffer(SnapshotBuffer *buffer) {
+  for (int i = 0; i < 3; i++) {
+    freeProjectiles(&buffer->slots[i].pc);
+  }
+}
+
+// the slot the writer fills next
+Snapshot *backSnapshot(SnapshotBuffer *buffer) {
+  return &buffer->slots[buffer->back];
+}
+
+// hand the filled back slot to the reader
+void publishSnapshot(SnapshotBuffer *buffer) {
+  int old = atomic_exchange(&buffer->ready, buffer->back | SNAPSHOT_FRESH);
+  buffer->back = old & ~SNAPSHOT_FRESH;
+}
+
+// the newest published snapshot, valid until the next call
+const Snapshot *latestSnapshot(SnapshotBuffer *buffer) {
+  if (atomic_load(&buffer->ready) & SNAPSHOT_FRESH) {
+    int old = atomic_exchange(&buffer->ready, buffer->front);
+    buffer->front = old & ~SNAPSHOT_FRESH;
+  }
+  return &buffer->slots[buffer->front];
+}
@@ -0,0 +1,47 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "game.h"
+#include "profiler.h"
+#include <stdatomic.h>
+
+/*
+ * read only copy of everything drawing needs from one simulation step, so
+ * the window can draw one step while the simulation works on the next
+ */
+typedef struct Snapshot {
+  double stepTime; // when the step was due, on the monotonicTime clock
+  long step;       // steps simulated up to this one
+  int roomIdx;
+  Color roomColor;
+  Block blocks[MAX_BLOCKS];
+  Character player;
+  Vector2 prevPlayer;
+  EnemiesContainer enemies;
+  ProjectilesContainer pc; // its own arrays, grown as needed
+} Snapshot;
+
+// set in SnapshotBuffer.ready when the slot there has not been taken yet
+#define SNAPSHOT_FRESH 4
+
+/*
+ * triple buffer of snapshots between one writer and one reader thread
+ * the writer fills back, then swaps it with ready, the reader swaps ready
+ * with front when there is a fresh one, so neither waits for the other
+ * and the reader always gets the newest complete snapshot
+ */
+typedef struct SnapshotBuffer {
+  Snapshot slots[3];
+  int back;        // writer only
+  int front;       // reader only
+  atomic_int ready; // slot index, ORed with SNAPSHOT_FRESH
+} SnapshotBuffer;
+
+void captureSnapshot(Snapshot *snap, Game *game, double stepTime);
+void initSnapshotBuffer(SnapshotBuffer *buffer, Game *game);
+void freeSnapshotBuffer(SnapshotBuffer *buffer);
+Snapshot *backSnapshot(SnapshotBuffer *buffer);
+void publishSnapshot(SnapshotBuffer *buffer);
+const Snapshot *latestSnapshot(SnapshotBuffer *buffer);
+
+#endif
@@ -0,0 +1,212 @@
+#include "sprites.h"
+#include "rlgl.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// squid.png is scaled down to this height in the atlas
+#define SQUID_HEIGHT 64
+// transparent pixels around every sprite, so filtering does not bleed
+#define SPRITE_PADDING 2
+
+// filled circle, ImageDrawCircle only draws the outline
+void fillCircle(Image *image, int cx, int cy, int r, Color color) {
+  for (int y = -r; y <= r; y++) {
+    int w = sqrtf(r * r - y * y);
+    ImageDrawRectangle(image, cx - w, cy + y, 2 * w + 1, 1, color);
+  }
+}
+
+// clear a light pixel and push it on the stack, to look at its neighbours
+void clearIfLight(Color *pixels, int i, int *stack, int *top) {
+  Color p = pixels[i];
+  if (p.a != 0 && p.r >= 200 && p.g >= 200 && p.b >= 200) {
+    pixels[i] = BLANK;
+    stack[(*top)++] = i;
+  }
+}
+
+/*
+ * make the light background around a drawing transparent, flood filling
+ * from the edges so the light parts inside its outline stay
+ */
+void clearBackground(Image *image) {
+  Color *pixels = image->data;
+  int w = image->width, h = image->height;
+  // pixels are cleared as they are pushed, so each is pushed at most once
+  int *stack = malloc(w * h * sizeof *stack);
+  int top = 0;
+  for (int x = 0; x < w; x++) {
+    clearIfLight(pixels, x, stack, &top);
+    clearIfLight(pixels, (h - 1) * w + x, stack, &top);
+  }
+  for (int y = 0; y < h; y++) {
+    clearIfLight(pixels, y * w, stack, &top);
+    clearIfLight(pixels, y * w + w - 1, stack, &top);
+  }
+  while (top > 0) {
+    int i = stack[--top];
+    int x = i % w, y = i / w;
+    if (x > 0) {
+      clearIfLight(pixels, i - 1, stack, &top);
+    }
+    if (x + 1 < w) {
+      clearIfLight(pixels, i + 1, stack, &top);
+    }
+    if (y > 0) {
+      clearIfLight(pixels, i - w, stack, &top);
+    }
+    if (y + 1 < h) {
+      clearIfLight(pixels, i + w, stack, &top);
+    }
+  }
+  free(stack);
+}
+
+Image bubbleImage(void) {
+  Image image = GenImageColor(SPRITE_SIZE, SPRITE_SIZE, BLANK);
+  int c = SPRITE_SIZE / 2;
+  fillCircle(&image, c, c, c - 1, (Color){40, 90, 200, 255});
+  fillCircle(&image, c, c, c - 5, (Color){110, 170, 240, 255});
+  // highlight, top left
+  fillCircle(&image, c - c / 3, c - c / 3, c / 5, RAYWHITE);
+  return image;
+}
+
+Image anglerfishImage(void) {
+  Image image = GenImageColor(SPRITE_SIZE, SPRITE_SIZE, BLANK);
+  int c = SPRITE_SIZE / 2;
+  // body, with the lure hanging over the front of the head
+  fillCircle(&image, c, c + 4, c - 6, (Color){30, 30, 40, 255});
+  ImageDrawLine(&image, c + 4, 10, c + 14, 2, DARKGRAY);
+  ImageDrawLine(&image, c + 14, 2, c + 22, 8, DARKGRAY);
+  fillCircle(&image, c + 22, 10, 4, YELLOW);
+  fillCircle(&image, c + 10, c - 2, 6, RAYWHITE);
+  fillCircle(&image, c + 11, c - 2, 3, BLACK);
+  // teeth along the mouth
+  for (int x = c - 14; x < c + 16; x += 6) {
+    ImageDrawRectangle(&image, x, c + 14, 3, 5, RAYWHITE);
+  }
+  return image;
+}
+
+Image squidImage(void) {
+  Image image = LoadImage(SQUID_PATH);
+  if (image.data == NULL) {
+    fprintf(stderr, "Failed loading %s, drawing the player as a circle\n",
+            SQUID_PATH);
+    image = GenImageColor(SPRITE_SIZE, SPRITE_SIZE, BLANK);
+    fillCircle(&image, SPRITE_SIZE / 2, SPRITE_SIZE / 2,
+               SPRITE_SIZE / 2 - 1, WHITE);
+    return image;
+  }
+  ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  clearBackground(&image);
+  ImageResize(&image, image.width * SQUID_HEIGHT / image.height,
+              SQUID_HEIGHT);
+  return image;
+}
+
+// the sprites side by side in one image, turned into a texture
+void loadSprites(SpriteBatch *batch) {
+  Image images[SPRITES];
+  images[SPRITE_SQUID] = squidImage();
+  images[SPRITE_BUBBLE] = bubbleImage();
+  images[SPRITE_ANGLERFISH] = anglerfishImage();
+
+  int width = 0;
+  int height = 0;
+  for (int i = 0; i < SPRITES; i++) {
+    width += images[i].width + 2 * SPRITE_PADDING;
+    int h = images[i].height + 2 * SPRITE_PADDING;
+    height = h > height ? h : height;
+  }
+  Image atlas = GenImageColor(width, height, BLANK);
+  int x = 0;
+  for (int i = 0; i < SPRITES; i++) {
+    Rectangle source = {0, 0, images[i].width, images[i].height};
+    batch->rects[i] = (Rectangle){x + SPRITE_PADDING, SPRITE_PADDING,
+                                  images[i].width, images[i].height};
+    ImageDraw(&atlas, images[i], source, batch->rects[i], WHITE);
+    x += images[i].width + 2 * SPRITE_PADDING;
+    UnloadImage(images[i]);
+  }
+  batch->atlas = LoadTextureFromImage(atlas);
+  SetTextureFilter(batch->atlas, TEXTURE_FILTER_BILINEAR);
+  UnloadImage(atlas);
+
+  batch->quads = NULL;
+  batch->sorted = NULL;
+  batch->count = 0;
+  batch->capacity = 0;
+}
+
+void unloadSprites(SpriteBatch *batch) {
+  UnloadTexture(batch->atlas);
+  free(batch->quads);
+  free(batch->sorted);
+  batch->quads = NULL;
+  batch->sorted = NULL;
+  batch->count = 0;
+  batch->capacity = 0;
+}
+
+void queueSprite(SpriteBatch *batch, SpriteId sprite, SpriteLayer layer,
+                 Vector2 center, float radius, Color tint) {
+  if (batch->count == batch->capacity) {
+    batch->capacity = batch->capacity ? batch->capacity * 2 : 256;
+    batch->quads =
+        realloc(batch->quads, batch->capacity * sizeof *batch->quads);
+    batch->sorted =
+        realloc(batch->sorted, batch->capacity * sizeof *batch->sorted);
+  }
+  // fit the longer side of the sprite to the diameter
+  Rectangle rect = batch->rects[sprite];
+  float scale = 2 * radius / (rect.width > rect.height ? rect.width
+                                                       : rect.height);
+  float w = rect.width * scale;
+  float h = rect.height * scale;
+  batch->quads[batch->count++] = (SpriteQuad){
+      {center.x - w / 2, center.y - h / 2, w, h}, tint, sprite, layer};
+}
+
+void drawSprites(SpriteBatch *batch) {
+  // counting sort, stable, so each layer keeps the order it was queued in
+  int start[LAYERS + 1] = {0};
+  for (int i = 0; i < batch->count; i++) {
+    start[batch->quads[i].layer + 1]++;
+  }
+  for (int l = 0; l < LAYERS; l++) {
+    start[l + 1] += start[l];
+  }
+  for (int i = 0; i < batch->count; i++) {
+    batch->sorted[start[batch->quads[i].layer]++] = batch->quads[i];
+  }
+
+  float texW = batch->atlas.width;
+  float texH = batch->atlas.height;
+  rlSetTexture(batch->atlas.id);
+  rlBegin(RL_QUADS);
+  for (int i = 0; i < batch->count; i++) {
+    const SpriteQuad *q = &batch->sorted[i];
+    Rectangle src = batch->rects[q->sprite];
+    Rectangle dst = q->dest;
+    float u0 = src.x / texW, u1 = (src.x + src.width) / texW;
+    float v0 = src.y / texH, v1 = (src.y + src.height) / texH;
+    // flushes to the gpu when the batch is full, then carries on
+    rlCheckRenderBatchLimit(4);
+    rlColor4ub(q->tint.r, q->tint.g, q->tint.b, q->tint.a);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+    rlTexCoord2f(u0, v0);
+    rlVertex2f(dst.x, dst.y);
+    rlTexCoord2f(u0, v1);
+    rlVertex2f(dst.x, dst.y + dst.height);
+    rlTexCoord2f(u1, v1);
+    rlVertex2f(dst.x + dst.width, dst.y + dst.height);
+    rlTexCoord2f(u1, v0);
+    rlVertex2f(dst.x + dst.width, dst.y);
+  }
+  rlEnd();
+  rlSetTexture(0);
+  batch->count = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include "raylib.h"
+
+// loaded into the atlas when found, a plain circle is drawn instead if not
+#define SQUID_PATH "squid.png"
+// size of the bubble and anglerfish sprites, drawn when the atlas is made
+#define SPRITE_SIZE 64
+
+typedef enum SpriteId {
+  SPRITE_SQUID,
+  SPRITE_BUBBLE,
+  SPRITE_ANGLERFISH,
+  SPRITES
+} SpriteId;
+
+// lower layers are drawn first
+typedef enum SpriteLayer {
+  LAYER_ENEMIES,
+  LAYER_PLAYER,
+  LAYER_BUBBLES,
+  LAYERS
+} SpriteLayer;
+
+typedef struct SpriteQuad {
+  Rectangle dest;
+  Color tint;
+  unsigned char sprite;
+  unsigned char layer;
+} SpriteQuad;
+
+/*
+ * every sprite in one texture, and the quads queued for the current frame
+ * they go to rlgl as one batch of quads on that texture, so the cost per
+ * sprite is four vertices, however many there are
+ */
+typedef struct SpriteBatch {
+  Texture2D atlas;
+  Rectangle rects[SPRITES]; // where each sprite is in the atlas
+  SpriteQuad *quads;
+  SpriteQuad *sorted; // the quads by layer, while drawing
+  int count;
+  int capacity;
+} SpriteBatch;
+
+// needs the window to be open
+void loadSprites(SpriteBatch *batch);
+void unloadSprites(SpriteBatch *batch);
+// queue a sprite fitted into the circle at center, keeping its aspect
+void queueSprite(SpriteBatch *batch, SpriteId sprite, SpriteLayer layer,
+                 Vector2 center, float radius, Color tint);
+// draw the queued sprites, layer by layer, and empty the queue
+void drawSprites(SpriteBatch *batch);
+
+#endif